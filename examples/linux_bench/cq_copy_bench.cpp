@@ -0,0 +1,140 @@
+/*
+============================================================================
+Name        : cq_copy_bench.cpp
+Author      : Valerii Proskurin
+Version     :
+Copyright   : Copyright (c) 2023, Valerii Proskurin. All rights reserved.
+Description : throughput of copies into/out of the circular queue buffer that
+cross its end, per element size. "block" is the library path (at most two
+memcpy() split at the end of the buffer), "wrapped" is the copy helper of the
+queue (single memcpy() when the element doesn't cross the end), "byte" is the
+former per-byte loop with the wrap check on every byte, "queue" is the add/get round trip through
+the public queue API. Buffer size is odd, so every element starts at another
+offset and a share of them wraps.
+Build (from this folder):
+	gcc -O2 -c -I../../pubsub_actors ../../pubsub_actors/circular_queue.c -o circular_queue.o
+	g++ -O2 -I../../pubsub_actors cq_copy_bench.cpp circular_queue.o -o cq_copy_bench
+	./cq_copy_bench
+============================================================================
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "circular_queue.h"
+
+#define BENCH_BUF_SIZE		(4093)
+#define BENCH_BYTES			(256u * 1024u * 1024u) //bytes copied per measurement
+
+//internal copy helpers of circular_queue.c
+extern "C" void * cq_wrappedCopyToBuff(CQ_S *pQueue, void * pStart, void * pSource, size_t length);
+extern "C" void * cq_wrappedCopyFromBuff(CQ_S *pQueue, void * pStart, void * pDest, size_t length);
+
+static char pu8Buf[BENCH_BUF_SIZE];
+static char pu8Elem[4096];
+static volatile char u8Sink;
+
+#if defined(__GNUC__)
+#define BENCH_NOINLINE	__attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+//former implementation of cq_wrappedCopyToBuff()/cq_wrappedCopyFromBuff(), kept as the baseline.
+//Not inlined, like the library functions called from another translation unit.
+static BENCH_NOINLINE void * byte_copy_to(char * pStart, const char * pSource, size_t length) {
+	for (size_t i = 0; i < length; ++i) {
+		*pStart++ = *pSource++;
+		if (pStart >= pu8Buf + BENCH_BUF_SIZE) pStart = pu8Buf;
+	}
+	return pStart;
+}
+
+static BENCH_NOINLINE void * byte_copy_from(const char * pStart, char * pDest, size_t length) {
+	for (size_t i = 0; i < length; ++i) {
+		*pDest++ = *pStart++;
+		if (pStart >= pu8Buf + BENCH_BUF_SIZE) pStart = pu8Buf;
+	}
+	return (void *)pStart;
+}
+
+//region of length bytes at the offset of the buffer, split at its end like the queue does it.
+static void make_region(size_t xOffset, size_t length, CQ_REGION_S * pRegion) {
+	size_t tillEnd = BENCH_BUF_SIZE - xOffset;
+	pRegion->pFirst = pu8Buf + xOffset;
+	pRegion->firstSize = (length <= tillEnd) ? length : tillEnd;
+	pRegion->pSecond = (length <= tillEnd) ? NULL : pu8Buf;
+	pRegion->secondSize = length - pRegion->firstSize;
+}
+
+static double elapsed_s(std::chrono::steady_clock::time_point xStart) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - xStart).count();
+}
+
+//returns MB/s of writing and reading back elements of xSize bytes.
+static double bench_block(size_t xSize, size_t xCount) {
+	CQ_REGION_S xRegion;
+	size_t xOffset = 0;
+	auto xStart = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < xCount; i++) {
+		make_region(xOffset, xSize, &xRegion);
+		(void)cq_copyToRegion(&xRegion, 0, pu8Elem, xSize);
+		(void)cq_copyFromRegion(&xRegion, 0, pu8Elem, xSize);
+		xOffset += xSize;
+		if (xOffset >= BENCH_BUF_SIZE) xOffset -= BENCH_BUF_SIZE;
+	}
+	u8Sink = pu8Elem[0];
+	return 2.0 * xSize * xCount / elapsed_s(xStart) / 1e6;
+}
+
+static double bench_wrapped(size_t xSize, size_t xCount) {
+	CQ_S xQueue;
+	cq_init(&xQueue, pu8Buf, sizeof(pu8Buf));
+	void * pStart = pu8Buf;
+	auto xStart = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < xCount; i++) {
+		(void)cq_wrappedCopyToBuff(&xQueue, pStart, pu8Elem, xSize);
+		pStart = cq_wrappedCopyFromBuff(&xQueue, pStart, pu8Elem, xSize);
+	}
+	u8Sink = pu8Elem[0];
+	return 2.0 * xSize * xCount / elapsed_s(xStart) / 1e6;
+}
+
+static double bench_byte(size_t xSize, size_t xCount) {
+	char * pStart = pu8Buf;
+	auto xStart = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < xCount; i++) {
+		(void)byte_copy_to(pStart, pu8Elem, xSize);
+		pStart = (char *)byte_copy_from(pStart, pu8Elem, xSize);
+	}
+	u8Sink = pu8Elem[0];
+	return 2.0 * xSize * xCount / elapsed_s(xStart) / 1e6;
+}
+
+static double bench_queue(size_t xSize, size_t xCount) {
+	CQ_S xQueue;
+	cq_init(&xQueue, pu8Buf, sizeof(pu8Buf));
+	auto xStart = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < xCount; i++) {
+		(void)cq_addTailElement(&xQueue, pu8Elem, xSize);
+		(void)cq_getFrontElement(&xQueue, pu8Elem, sizeof(pu8Elem));
+	}
+	u8Sink = pu8Elem[0];
+	return 2.0 * xSize * xCount / elapsed_s(xStart) / 1e6;
+}
+
+int main() {
+	static const size_t pxSizes[] = { 1, 2, 4, 8, 12, 16, 24, 32, 48, 64, 128, 256, 512, 1024, 4000 };
+	memset(pu8Elem, 0x5A, sizeof(pu8Elem));
+	printf("%8s %12s %12s %12s %12s %8s\n", "size", "block MB/s", "wrapped MB/s", "byte MB/s", "queue MB/s", "speedup");
+	for (size_t i = 0; i < sizeof(pxSizes) / sizeof(pxSizes[0]); i++) {
+		size_t xCount = BENCH_BYTES / pxSizes[i] / 2;
+		if (xCount > 50000000u) xCount = 50000000u; //per-call overhead dominates tiny sizes anyway
+		double dBlock = bench_block(pxSizes[i], xCount);
+		double dWrapped = bench_wrapped(pxSizes[i], xCount);
+		double dByte = bench_byte(pxSizes[i], xCount);
+		double dQueue = bench_queue(pxSizes[i], xCount);
+		printf("%8zu %12.0f %12.0f %12.0f %12.0f %7.1fx\n", pxSizes[i], dBlock, dWrapped, dByte, dQueue, dWrapped / dByte);
+	}
+	return 0;
+}
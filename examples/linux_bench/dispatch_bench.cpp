@@ -0,0 +1,274 @@
+/*
+============================================================================
+Name        : dispatch_bench.cpp
+Author      : Valerii Proskurin
+Version     :
+Copyright   : Copyright (c) 2023, Valerii Proskurin. All rights reserved.
+Description : dispatch cost with 1k+ topics after caches were flushed by other
+work. Part 1 runs ps_loop_n() over messages of random topics. Part 2 repeats
+the per-message topic access (data type and subscribers) over the
+former topic table, where path, info, subscriber/publisher arrays and the last
+message lived in one struct, and over the current dense hot table.
+Cache misses are read by perf_event_open() (Linux), "n/a" if the kernel or the
+VM doesn't expose hardware counters (see /proc/sys/kernel/perf_event_paranoid).
+Build (from this folder):
+	gcc -O2 -c -I../../pubsub_actors ../../pubsub_actors/circular_queue.c -o circular_queue.o
+	g++ -O2 -DPS_MAX_TOPICS_COUNT=10000 -DPS_MAX_TOPIC_NODES_COUNT=10200 -DPS_TOPIC_NODES_INDEX_SIZE=32768 -I../../pubsub_actors \
+		dispatch_bench.cpp ../../pubsub_actors/pubsub.cpp circular_queue.o -o dispatch_bench
+	./dispatch_bench
+============================================================================
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "pubsub.h"
+
+#if (PS_MAX_TOPICS_COUNT < 10000)
+#error "build with -DPS_MAX_TOPICS_COUNT=10000 (see the header of the file)"
+#endif
+
+#define BENCH_BATCH			(100u) //messages published before dispatching, they fit into the default queue
+#define BENCH_ROUNDS		(2000u)
+#define BENCH_EVICT_SIZE	(16u * 1024u * 1024u) //walked between publishing and dispatching, larger than the last level cache
+
+static char pu8Evict[BENCH_EVICT_SIZE];
+static volatile uint32_t u32Sink;
+static uint32_t u32Delivered;
+static int iMissesFd = -1;
+
+//*******************************   cache miss counter ***************************************************
+
+static void misses_open() {
+#if defined(__linux__)
+	struct perf_event_attr xAttr;
+	memset(&xAttr, 0, sizeof(xAttr));
+	xAttr.size = sizeof(xAttr);
+	xAttr.type = PERF_TYPE_HARDWARE;
+	xAttr.config = PERF_COUNT_HW_CACHE_MISSES;
+	xAttr.exclude_kernel = 1;
+	xAttr.exclude_hv = 1;
+	iMissesFd = (int)syscall(SYS_perf_event_open, &xAttr, 0, -1, -1, 0);
+#endif
+}
+
+static void misses_start() {
+#if defined(__linux__)
+	if (iMissesFd >= 0) {
+		(void)ioctl(iMissesFd, PERF_EVENT_IOC_RESET, 0);
+		(void)ioctl(iMissesFd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+//returns misses since misses_start(), -1 if the counter isn't available.
+static long long misses_stop() {
+	long long llCount = -1;
+#if defined(__linux__)
+	if (iMissesFd >= 0) {
+		(void)ioctl(iMissesFd, PERF_EVENT_IOC_DISABLE, 0);
+		if (sizeof(llCount) != read(iMissesFd, &llCount, sizeof(llCount))) llCount = -1;
+	}
+#endif
+	return llCount;
+}
+
+static void print_misses(long long llMisses, uint32_t u32Count) {
+	if (llMisses < 0) {
+		printf(" %14s\n", "n/a");
+	} else {
+		printf(" %14.2f\n", (double)llMisses / u32Count);
+	}
+}
+
+//stands for other work of the application between publishing and dispatching.
+static void evict_caches() {
+	uint32_t u32Sum = 0;
+	for (uint32_t i = 0; i < BENCH_EVICT_SIZE; i += 64) {
+		pu8Evict[i]++;
+		u32Sum += (uint8_t)pu8Evict[i];
+	}
+	u32Sink = u32Sum;
+}
+
+static uint32_t random_topic(uint32_t * pu32Seed, uint32_t u32TopicsCount) {
+	*pu32Seed = *pu32Seed * 1664525u + 1013904223u;
+	return (*pu32Seed >> 8) % u32TopicsCount;
+}
+
+//*******************************   part 1: library dispatch ***************************************************
+
+const char * bench_pub(PsTopicHash_t xTopicHash, void * pvMsg, size_t xMsgLength, PsDataType_e xMsgDataType) {
+	(void)xTopicHash;
+	(void)pvMsg;
+	(void)xMsgLength;
+	(void)xMsgDataType;
+	return "bench publisher";
+}
+
+const char * bench_sub(PsTopicHash_t xTopicHash, void * pvMsg, size_t xMsgLength, PsDataType_e xMsgDataType) {
+	(void)xTopicHash;
+	(void)xMsgLength;
+	(void)xMsgDataType;
+	if (NULL != pvMsg) u32Delivered += *(uint32_t *)pvMsg;
+	return "bench subscriber";
+}
+
+void restart_timer(long int tout_ms) {
+	(void)tout_ms;
+}
+
+long int get_timer_tick_ms() {
+	return 0;
+}
+
+static void bench_dispatch(uint32_t u32TopicsCount) {
+	static PsTopicHash_t TopicHashes[PS_MAX_TOPICS_COUNT];
+	char pu8PathStr[PS_MAX_TOPIC_PATH_STR_LENGTH];
+	if (PS_RESULT_OK != ps_init(restart_timer, get_timer_tick_ms)) return;
+	for (uint32_t i = 0; i < u32TopicsCount; i++) {
+		snprintf(pu8PathStr, sizeof(pu8PathStr), ".dev%u.ch%u", (unsigned)(i / 100), (unsigned)(i % 100));
+		if (PS_RESULT_OK != ps_register_topic_publisher(bench_pub, PS_DTYPE_U32, pu8PathStr, "bench topic", 0, &TopicHashes[i])) {
+			printf("registration of %s failed\n", pu8PathStr);
+			return;
+		}
+	}
+	if (PS_RESULT_OK != ps_sub_single_topic(".#", PS_DTYPE_NONE, bench_sub, NULL, NULL, NULL, NULL)) return;
+	uint32_t u32Seed = 1;
+	uint32_t u32Count = 0;
+	double dNs = 0;
+	long long llMisses = 0;
+	for (uint32_t u32Round = 0; u32Round < BENCH_ROUNDS; u32Round++) {
+		for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+			uint32_t u32Value = 1;
+			if (PS_RESULT_OK != ps_pub_topic(bench_pub, TopicHashes[random_topic(&u32Seed, u32TopicsCount)], sizeof(u32Value), &u32Value)) break;
+		}
+		evict_caches();
+		misses_start();
+		auto xStart = std::chrono::steady_clock::now();
+		int16_t i16Dispatched = ps_loop_n(UINT16_MAX, NULL);
+		dNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - xStart).count();
+		long long llRoundMisses = misses_stop();
+		llMisses = ((llMisses < 0) || (llRoundMisses < 0)) ? -1 : llMisses + llRoundMisses;
+		if (i16Dispatched > 0) u32Count += (uint32_t)i16Dispatched;
+	}
+	if (u32Delivered != u32Count) printf("lost messages: %u of %u\n", (unsigned)(u32Count - u32Delivered), (unsigned)u32Count);
+	u32Delivered = 0;
+	printf("%8u %14.1f", (unsigned)u32TopicsCount, dNs / u32Count);
+	print_misses(llMisses, u32Count);
+}
+
+//*******************************   part 2: topic table layout ***************************************************
+
+#define BENCH_ACTORS_COUNT	(8)
+//topic table entry before the hot/cold split
+typedef struct _FormerTopicStruct_s {
+	uint16_t u16Hash;
+	PsDataType_e xDtype;
+	uint8_t u8Sticky_flag;
+	uint16_t xNode;
+	char pu8TopicInfoStr[PS_MAX_TOPIC_INFO_STR_LENGTH];
+	actor_f pxSubscribers[BENCH_ACTORS_COUNT];
+	uint8_t u8SubscribersFlags[BENCH_ACTORS_COUNT];
+	actor_f pxPublishers[BENCH_ACTORS_COUNT];
+	uint8_t u8PublishersMute[BENCH_ACTORS_COUNT];
+	uint16_t xLastMsgTopicHash;
+	uint8_t pu8LastMsgPayload[PS_MAX_MESSAGE_PAYLOAD_LENGTH];
+} FormerTopicStruct_s;
+
+//layout of the current hot topic table entry (PsTopicStruct_s of pubsub.cpp)
+typedef struct _HotTopicStruct_s {
+	uint16_t xNode;
+	uint8_t u8Priority;
+	uint8_t u8Conflate_flag;
+	PsDataType_e xDtype;
+	uint8_t u8Sticky_flag;
+	uint8_t u8Inline_flag;
+	uint16_t xMaxMsgLen;
+	uint32_t xSubscribers;
+	uint32_t xPublishers;
+	uint32_t xPublishersMute;
+} HotTopicStruct_s;
+
+static std::vector<FormerTopicStruct_s> FormerTopics;
+static std::vector<HotTopicStruct_s> HotTopics;
+static actor_f ActorsArray[BENCH_ACTORS_COUNT];
+
+//what dispatching reads from the former table: data type and the subscribers list walked till its end.
+static uint32_t former_access(uint32_t u32Topic) {
+	const FormerTopicStruct_s * pxTopic = &FormerTopics[u32Topic];
+	uint32_t u32Sum = (uint32_t)pxTopic->xDtype;
+	for (uint32_t i = 0; (i < BENCH_ACTORS_COUNT) && (NULL != pxTopic->pxSubscribers[i]); i++) {
+		u32Sum += (uint32_t)(uintptr_t)pxTopic->pxSubscribers[i];
+	}
+	return u32Sum;
+}
+
+//the same read from the hot table: subscriber set is a bit mask of actor ids.
+static uint32_t hot_access(uint32_t u32Topic) {
+	const HotTopicStruct_s * pxTopic = &HotTopics[u32Topic];
+	uint32_t u32Sum = (uint32_t)pxTopic->xDtype;
+	for (uint32_t xSet = pxTopic->xSubscribers; 0 != xSet; xSet &= xSet - 1) {
+		u32Sum += (uint32_t)(uintptr_t)ActorsArray[__builtin_ctz(xSet)];
+	}
+	return u32Sum;
+}
+
+static void bench_layout(const char * pu8NameStr, uint32_t(*access)(uint32_t), uint32_t u32TopicsCount) {
+	uint32_t u32Seed = 1;
+	uint32_t u32Sum = 0;
+	double dNs = 0;
+	long long llMisses = 0;
+	for (uint32_t u32Round = 0; u32Round < BENCH_ROUNDS; u32Round++) {
+		evict_caches();
+		misses_start();
+		auto xStart = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+			u32Sum += access(random_topic(&u32Seed, u32TopicsCount));
+		}
+		dNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - xStart).count();
+		long long llRoundMisses = misses_stop();
+		llMisses = ((llMisses < 0) || (llRoundMisses < 0)) ? -1 : llMisses + llRoundMisses;
+	}
+	u32Sink = u32Sum;
+	printf("%8u %8s %14.1f", (unsigned)u32TopicsCount, pu8NameStr, dNs / (BENCH_ROUNDS * BENCH_BATCH));
+	print_misses(llMisses, BENCH_ROUNDS * BENCH_BATCH);
+}
+
+int main() {
+	static const uint32_t pu32Counts[] = { 1000, 4000, 10000 };
+	misses_open();
+	printf("library dispatch, one wildcard subscriber\n");
+	printf("%8s %14s %14s\n", "topics", "ns/msg", "misses/msg");
+	for (uint32_t i = 0; i < sizeof(pu32Counts) / sizeof(pu32Counts[0]); i++) {
+		bench_dispatch(pu32Counts[i]);
+	}
+	printf("\ntopic access of dispatching, former entry %u bytes, hot entry %u bytes\n",
+		(unsigned)sizeof(FormerTopicStruct_s), (unsigned)sizeof(HotTopicStruct_s));
+	printf("%8s %8s %14s %14s\n", "topics", "table", "ns/msg", "misses/msg");
+	for (uint32_t i = 0; i < BENCH_ACTORS_COUNT; i++) {
+		ActorsArray[i] = (i < 2) ? bench_sub : NULL;
+	}
+	for (uint32_t i = 0; i < sizeof(pu32Counts) / sizeof(pu32Counts[0]); i++) {
+		//two subscribers per topic in both tables
+		FormerTopics.assign(pu32Counts[i], FormerTopicStruct_s());
+		HotTopics.assign(pu32Counts[i], HotTopicStruct_s());
+		for (uint32_t j = 0; j < pu32Counts[i]; j++) {
+			FormerTopics[j].xDtype = PS_DTYPE_U32;
+			FormerTopics[j].pxSubscribers[0] = bench_sub;
+			FormerTopics[j].pxSubscribers[1] = bench_pub;
+			HotTopics[j].xDtype = PS_DTYPE_U32;
+			HotTopics[j].xSubscribers = 0x3;
+		}
+		bench_layout("former", former_access, pu32Counts[i]);
+		bench_layout("hot", hot_access, pu32Counts[i]);
+	}
+	return 0;
+}
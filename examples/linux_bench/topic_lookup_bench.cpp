@@ -0,0 +1,99 @@
+/*
+============================================================================
+Name        : topic_lookup_bench.cpp
+Author      : Valerii Proskurin
+Version     :
+Copyright   : Copyright (c) 2023, Valerii Proskurin. All rights reserved.
+Description : cost of topic registration and lookup by path with 10, 1k and
+10k topics. "lookup" is ps_check_topic() (hashed topics tree), "linear" is the
+former strncmp() scan over all topic paths, kept as the baseline.
+Build (from this folder):
+	gcc -O2 -c -I../../pubsub_actors ../../pubsub_actors/circular_queue.c -o circular_queue.o
+	g++ -O2 -DPS_MAX_TOPICS_COUNT=10000 -DPS_MAX_TOPIC_NODES_COUNT=10200 -DPS_TOPIC_NODES_INDEX_SIZE=32768 -I../../pubsub_actors \
+		topic_lookup_bench.cpp ../../pubsub_actors/pubsub.cpp circular_queue.o -o topic_lookup_bench
+	./topic_lookup_bench
+============================================================================
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "pubsub.h"
+
+#if (PS_MAX_TOPICS_COUNT < 10000)
+#error "build with -DPS_MAX_TOPICS_COUNT=10000 (see the header of the file)"
+#endif
+
+#define BENCH_LOOKUPS		(1000000u)
+#define BENCH_LINEAR_LOOKUPS	(20000u) //the scan is O(N), fewer lookups keep the run short
+
+static char TopicPaths[PS_MAX_TOPICS_COUNT][PS_MAX_TOPIC_PATH_STR_LENGTH];
+static volatile uint32_t u32Sink;
+
+const char * bench_act(PsTopicHash_t xTopicHash, void * pvMsg, size_t xMsgLength, PsDataType_e xMsgDataType) {
+	(void)xTopicHash;
+	(void)pvMsg;
+	(void)xMsgLength;
+	(void)xMsgDataType;
+	return "bench";
+}
+
+void restart_timer(long int tout_ms) {
+	(void)tout_ms;
+}
+
+long int get_timer_tick_ms() {
+	return 0;
+}
+
+static double elapsed_ns(std::chrono::steady_clock::time_point xStart) {
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - xStart).count();
+}
+
+//former ps_find_topic(): compares the path with every topic slot.
+static uint32_t linear_find(const char * pu8TopicPathStr, uint32_t u32TopicsCount) {
+	for (uint32_t i = 0; i < u32TopicsCount; i++) {
+		if (0 == strncmp(TopicPaths[i], pu8TopicPathStr, PS_MAX_TOPIC_PATH_STR_LENGTH)) return i;
+	}
+	return UINT32_MAX;
+}
+
+static void bench(uint32_t u32TopicsCount) {
+	PsTopicHash_t xTopicHash;
+	PsDataType_e xDataType;
+	char pu8InfoStr[PS_MAX_TOPIC_INFO_STR_LENGTH];
+	if (PS_RESULT_OK != ps_init(restart_timer, get_timer_tick_ms)) return;
+	//100 channels per device, like ".dev12.ch34"
+	for (uint32_t i = 0; i < u32TopicsCount; i++) {
+		snprintf(TopicPaths[i], sizeof(TopicPaths[i]), ".dev%u.ch%u", (unsigned)(i / 100), (unsigned)(i % 100));
+	}
+	auto xStart = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < u32TopicsCount; i++) {
+		if (PS_RESULT_OK != ps_register_topic_publisher(bench_act, PS_DTYPE_U32, TopicPaths[i], "bench topic", 0, &xTopicHash)) {
+			printf("registration of %s failed\n", TopicPaths[i]);
+			return;
+		}
+	}
+	double dRegisterNs = elapsed_ns(xStart) / u32TopicsCount;
+	uint32_t u32Sum = 0;
+	xStart = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < BENCH_LOOKUPS; i++) {
+		if (PS_RESULT_OK == ps_check_topic(TopicPaths[(i * 7919u) % u32TopicsCount], &xDataType, pu8InfoStr, &xTopicHash)) u32Sum += xTopicHash;
+	}
+	double dLookupNs = elapsed_ns(xStart) / BENCH_LOOKUPS;
+	xStart = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < BENCH_LINEAR_LOOKUPS; i++) {
+		u32Sum += linear_find(TopicPaths[(i * 7919u) % u32TopicsCount], u32TopicsCount);
+	}
+	double dLinearNs = elapsed_ns(xStart) / BENCH_LINEAR_LOOKUPS;
+	u32Sink = u32Sum;
+	printf("%8u %14.0f %12.0f %12.0f\n", (unsigned)u32TopicsCount, dRegisterNs, dLookupNs, dLinearNs);
+}
+
+int main() {
+	printf("%8s %14s %12s %12s\n", "topics", "register ns", "lookup ns", "linear ns");
+	bench(10);
+	bench(1000);
+	bench(10000);
+	return 0;
+}
@@ -47,6 +47,7 @@ top to bottom direction
 #include <stdlib.h>
 #include <conio.h>
 #include "../../pubsub_actors/pubsub.h"
+#include "../../pubsub_actors/pubsub_typed.h"
 
 #define EMBEDDED_CLI_IMPL
 #include "../../3rd_party/embedded_cli/embedded_cli.h"
@@ -65,38 +66,34 @@ char stdin_buf[100];
 
 static bool exitFlag = false;
 
-const char * reader_act(uint16_t u16TopicHash, void* pvMsg, size_t xMsgLendth, PsDataType_e xMsgDataType) {
-	const char * pTopicPathStr, * pTopicInfoStr;
-	PsDataType_e dtype;
+static ps::Topic<bool> ConsoleBoolTopic("sys.console.bool");
 
+//receives changes of the topics list (strings)
+const char * reader_act(uint16_t u16TopicHash, void* pvMsg, size_t xMsgLendth, PsDataType_e xMsgDataType) {
 	if (NULL != pvMsg) {
-		switch (xMsgDataType)
-		{
-		case PS_DTYPE_BOOL:			
-			ps_check_topic_by_hash(u16TopicHash, &pTopicPathStr, &pTopicInfoStr, &dtype);
-			printf("Received bool %u from %s topic (%s) \r\n", *(uint8_t*)pvMsg, pTopicPathStr, pTopicInfoStr);
-			break;
-		case PS_DTYPE_STR:
-			printf("SYSTEM - %.*s\r\n", xMsgLendth, (const char *)pvMsg);
-			break;
-		default:
-			printf("Unsupported Dtype %u\r\n", xMsgDataType);
-			break;
-		}
-	}	
+		printf("SYSTEM - %.*s\r\n", (int)xMsgLendth, (const char *)pvMsg);
+	}
 	return "reader/consumer actor\r\n";
 }
 
+//typed subscriber: value arrives as bool, no data type switch
+void reader_on_bool(PsTopicHash_t u16TopicHash, const bool & bValue) {
+	char pTopicPathStr[PS_MAX_TOPIC_PATH_STR_LENGTH];
+	const char * pTopicInfoStr;
+	ps_check_topic_by_hash(u16TopicHash, pTopicPathStr, &pTopicInfoStr, NULL);
+	printf("Received bool %u from %s topic (%s) \r\n", (unsigned)bValue, pTopicPathStr, pTopicInfoStr);
+}
+
 void reader_init() {
 	ps_create_and_sub_tpc_change_topic(reader_act);
-	ps_sub_single_topic("sys.console.bool", PS_DTYPE_BOOL, reader_act, NULL, NULL, NULL, NULL);
+	ConsoleBoolTopic.subscribe<reader_on_bool>();
 }
 
 
 const char * console_act(uint16_t u16TopicHash, void* pvMsg, size_t xMsgLendth, PsDataType_e xMsgDataType) {
 	if (NULL != pvMsg) {
-		const char * pcTopicPath;
-		ps_check_topic_by_hash(u16TopicHash, &pcTopicPath, NULL, NULL);
+		char pcTopicPath[PS_MAX_TOPIC_PATH_STR_LENGTH];
+		ps_check_topic_by_hash(u16TopicHash, pcTopicPath, NULL, NULL);
 		printf("Received %s msg\r\n", pcTopicPath);
 	}
 	return "console actor\r\n";
@@ -265,56 +262,57 @@ void console() {
 	}
 }
 
-long int timer_tick_ms = 0;
-long int timer_tout_ms = 0;
+DWORD timer_start_ms = 0;
+HANDLE hWakeupEvent = NULL; //set when a message is posted from another thread (ISR) while we sleep
+bool bSleepReported = false;
 
+//timeout isn't programmed, ps_idle() sleeps till the deadline itself
 void restart_timer(long int tout_ms) {
-	timer_tick_ms = 0;
-	timer_tout_ms = tout_ms;
+	timer_start_ms = GetTickCount();
 }
 
 long int get_timer_tick_ms() {
-	return timer_tick_ms;
+	return (long int)(GetTickCount() - timer_start_ms);
 }
 
-//imitate timer interrupts
-void loop_timer(void) {
-	Sleep(100); //100ms sleep
-	if (timer_tout_ms) {
-		//we have some timer to run
-		timer_tick_ms += 100;
-		if (timer_tick_ms >= timer_tout_ms) {
-			//timer expired - notify pubsub dispatcher
-			ps_pub_timer_tout_event();
-		}
+//imitate low power mode: sleep till the timer deadline, key press or message from ISR
+void enter_sleep(long int max_ms) {
+	if (!bSleepReported) {
+		printf("---\\___ Start sleep (%ld ms)\r\n", max_ms);
+		bSleepReported = true;
 	}
+	if (_kbhit()) return;
+	HANDLE hWakeupSources[2] = { hWakeupEvent, GetStdHandle(STD_INPUT_HANDLE) };
+	WaitForMultipleObjects(2, hWakeupSources, FALSE, (PS_IDLE_FOREVER == max_ms) ? INFINITE : (DWORD)max_ms);
 }
 
-void check_sleep(int busy) {
-	static int old_busy = 1;
-	if (old_busy > 0) {
-		if (busy == 0) {
-			printf("---\\___ Start sleep\r\n");
-			old_busy = busy;
-		}
-	} else {
-		if (busy != 0) {
-			printf("___/--- End sleep\r\n");
-			old_busy = busy;
-		}
+void on_wakeup() {
+	//mouse and focus events keep console input signaled, only key presses wake us up
+	if (!_kbhit()) FlushConsoleInputBuffer(GetStdHandle(STD_INPUT_HANDLE));
+}
+
+void cancel_sleep() {
+	SetEvent(hWakeupEvent);
+}
+
+void check_busy(int16_t processed) {
+	if (bSleepReported && (processed > 0)) {
+		printf("___/--- End sleep\r\n");
+		bSleepReported = false;
 	}
 }
 
 int main(void) {
 	ps_init(restart_timer, get_timer_tick_ms);
+	hWakeupEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	ps_set_idle_hooks(enter_sleep, on_wakeup, cancel_sleep);
 	reader_init();
 	console_init();	
 
 	while (!exitFlag) {
 		if (cli == NULL) break;		
-		loop_timer();
-		check_sleep(ps_get_waiting_events_count());
-		ps_loop();
+		check_busy(ps_loop());
+		ps_idle(); //sleeps till the next timer deadline if there is nothing to do
 		console(); //read new events
 	}
 	return EXIT_SUCCESS;
@@ -6,7 +6,8 @@ Version     : v 0.0.1
 Copyright   : Copyright (c) 2023, Valerii Proskurin. All rights reserved.
 Description : implementation of circular FIFO queue with elements of variable
 size located in a statically allocated array. Not thread safe!
-Must be called ONLY from safe section to avoid queue corruption.
+Must be called ONLY from safe section to avoid queue corruption. If CQ_CFG_LOCK_FREE_SPSC
+is enabled one producer and one consumer can access the queue concurrently without locks.
 License     : SPDX-License-Identifier: GPL-3.0-or-later OR commercial.
 This program is free software: you can redistribute it and/or modify
 it under the terms of the GNU General Public License as published by
@@ -25,17 +26,67 @@ In addition, this program is available under a commercial license
 from author (Valerii Proskurin). If you do not wish to be bound by the
 terms of the GPL, or you require a more permissive license for commercial use,
 please contact author via easyvolts@gmail.com for licensing options.
-============================================================================
+============================================================================
 */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE //memfd_create()
+#endif
 #include "circular_queue.h"
+#include <string.h>
+#if CQ_CFG_MIRRORED_BUFFER
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #define PRINT_DEBUG_CQ(...) // PRINT_INFO("CQ",__VA_ARGS__)
+#define CQ_SHORT_COPY_SIZE	(8) //copies up to this size are done by bytes, longer ones by memcpy()
+
+//running counters shared between producer and consumer are published with release and read with acquire ordering,
+//so data written into the buffer is visible to another side before the counter that makes it available.
+#if CQ_CFG_LOCK_FREE_SPSC
+#if defined(__GNUC__) || defined(__clang__)
+#define CQ_LOAD_ACQUIRE(var)		__atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define CQ_STORE_RELEASE(var, val)	__atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+//volatile accesses have no ordering on ARM (/volatile:iso is the default there), so the barriers are explicit:
+//x86/x64 keeps loads and stores ordered by hardware and needs only the compiler barrier, ARM needs dmb.
+#if defined(_M_ARM64)
+#define CQ_HW_FENCE()				__dmb(_ARM64_BARRIER_ISH)
+#elif defined(_M_ARM)
+#define CQ_HW_FENCE()				__dmb(_ARM_BARRIER_ISH)
+#else
+#define CQ_HW_FENCE()
+#endif
+static __forceinline size_t cq_loadAcquire(volatile size_t * pVar) {
+	size_t val = *pVar;
+	_ReadWriteBarrier();
+	CQ_HW_FENCE();
+	return val;
+}
+static __forceinline void cq_storeRelease(volatile size_t * pVar, size_t val) {
+	CQ_HW_FENCE();
+	_ReadWriteBarrier();
+	*pVar = val;
+}
+#define CQ_LOAD_ACQUIRE(var)		cq_loadAcquire(&(var))
+#define CQ_STORE_RELEASE(var, val)	cq_storeRelease(&(var), (val))
+#else
+#error "CQ_CFG_LOCK_FREE_SPSC: atomic load/store is not implemented for this compiler"
+#endif
+#else
+#define CQ_LOAD_ACQUIRE(var)		(var)
+#define CQ_STORE_RELEASE(var, val)	((var) = (val))
+#endif
 
 void cq_flush(CQ_S *pQueue) {
 	pQueue->pRear = pQueue->pDataBegin;
 	pQueue->pFront = pQueue->pDataBegin;
-	pQueue->count = 0;
-	pQueue->freeSize = pQueue->totalSize;
+	pQueue->bytesIn = 0;
+	pQueue->bytesOut = 0;
+	pQueue->elemsIn = 0;
+	pQueue->elemsOut = 0;
+	pQueue->reservedSize = 0;
 }
 
 void cq_init(CQ_S *pQueue, void * qBuffer, size_t qBufferSize)
@@ -43,90 +94,275 @@ void cq_init(CQ_S *pQueue, void * qBuffer, size_t qBufferSize)
 	pQueue->pDataBegin = qBuffer;
 	pQueue->pDataEnd = (char*)qBuffer + qBufferSize;
 	pQueue->totalSize = qBufferSize;
+	pQueue->mirrored = false;
 	cq_flush(pQueue);
 }
 
+#if CQ_CFG_MIRRORED_BUFFER
+bool cq_initMirrored(CQ_S *pQueue, size_t qBufferSize)
+{
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t size = ((qBufferSize + pageSize - 1) / pageSize) * pageSize;
+	int fd = memfd_create("cq_mirror", MFD_CLOEXEC);
+	if (fd < 0) return false;
+	if (0 != ftruncate(fd, (off_t)size)) {
+		close(fd);
+		return false;
+	}
+	//reserve address space for both copies, then map the same pages into both halves of it
+	char * pBase = (char*)mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == (void*)pBase) {
+		close(fd);
+		return false;
+	}
+	if ((MAP_FAILED == mmap(pBase, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0)) ||
+		(MAP_FAILED == mmap(pBase + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0))) {
+		munmap(pBase, 2 * size);
+		close(fd);
+		return false;
+	}
+	close(fd); //mappings keep the memory alive
+	cq_init(pQueue, pBase, size);
+	pQueue->mirrored = true;
+	return true;
+}
+
+void cq_deinitMirrored(CQ_S *pQueue)
+{
+	if (!pQueue->mirrored) return;
+	munmap(pQueue->pDataBegin, 2 * pQueue->totalSize);
+	pQueue->pDataBegin = NULL;
+	pQueue->pDataEnd = NULL;
+	pQueue->mirrored = false;
+}
+#endif
+
+size_t cq_usedSpace(CQ_S *pQueue) {
+	return CQ_LOAD_ACQUIRE(pQueue->bytesIn) - CQ_LOAD_ACQUIRE(pQueue->bytesOut);
+}
+
 bool cq_hasSpace(CQ_S *pQueue, size_t elementSize) {
-	return (pQueue->freeSize >= (elementSize + sizeof(CQ_ELEM_HEADER_S)));
+	return ((pQueue->totalSize - cq_usedSpace(pQueue)) >= (elementSize + sizeof(CQ_ELEM_HEADER_S)));
 }
 
+//fills region that starts at pStart (inside of the queue buffer) and has specific length
+static void cq_makeRegion(CQ_S *pQueue, void * pStart, size_t length, CQ_REGION_S *pRegion) {
+	size_t tillEnd = (size_t)((char*)pQueue->pDataEnd - (char*)pStart);
+	pRegion->pFirst = pStart;
+	if (pQueue->mirrored || (length <= tillEnd)) {
+		//mirrored buffer continues after its end, so region is always contiguous
+		pRegion->firstSize = length;
+		pRegion->pSecond = NULL;
+		pRegion->secondSize = 0;
+	}
+	else {
+		pRegion->firstSize = tillEnd;
+		pRegion->pSecond = pQueue->pDataBegin;
+		pRegion->secondSize = length - tillEnd;
+	}
+}
+
+void cq_subRegion(const CQ_REGION_S *pRegion, size_t offset, CQ_REGION_S *pSubRegion) {
+	if ((offset < pRegion->firstSize) || (NULL == pRegion->pSecond)) {
+		pSubRegion->pFirst = (char*)pRegion->pFirst + offset;
+		pSubRegion->firstSize = pRegion->firstSize - offset;
+		pSubRegion->pSecond = pRegion->pSecond;
+		pSubRegion->secondSize = pRegion->secondSize;
+	}
+	else {
+		//sub-region is located completely in the wrapped part
+		offset -= pRegion->firstSize;
+		pSubRegion->pFirst = (char*)pRegion->pSecond + offset;
+		pSubRegion->firstSize = pRegion->secondSize - offset;
+		pSubRegion->pSecond = NULL;
+		pSubRegion->secondSize = 0;
+	}
+}
+
+bool cq_copyToRegion(const CQ_REGION_S *pRegion, size_t offset, const void * pSource, size_t length) {
+	CQ_REGION_S subRegion;
+	if ((offset + length) > (pRegion->firstSize + pRegion->secondSize)) return false;
+	if (0 == length) return true;
+	cq_subRegion(pRegion, offset, &subRegion);
+	if (length <= subRegion.firstSize) {
+		memcpy(subRegion.pFirst, pSource, length);
+	}
+	else {
+		memcpy(subRegion.pFirst, pSource, subRegion.firstSize);
+		memcpy(subRegion.pSecond, (const char*)pSource + subRegion.firstSize, length - subRegion.firstSize);
+	}
+	return true;
+}
+
+bool cq_copyFromRegion(const CQ_REGION_S *pRegion, size_t offset, void * pDest, size_t length) {
+	CQ_REGION_S subRegion;
+	if ((offset + length) > (pRegion->firstSize + pRegion->secondSize)) return false;
+	if (0 == length) return true;
+	cq_subRegion(pRegion, offset, &subRegion);
+	if (length <= subRegion.firstSize) {
+		memcpy(pDest, subRegion.pFirst, length);
+	}
+	else {
+		memcpy(pDest, subRegion.pFirst, subRegion.firstSize);
+		memcpy((char*)pDest + subRegion.firstSize, subRegion.pSecond, length - subRegion.firstSize);
+	}
+	return true;
+}
+
+//copies block which doesn't wrap, short ones (element headers, scalar payloads) go byte by byte as memcpy() call costs more for them
+static void cq_copyBlock(void * pDest, const void * pSource, size_t length) {
+	if (length <= CQ_SHORT_COPY_SIZE) {
+		char * pDestByte = (char*)pDest;
+		const char * pSourceByte = (const char*)pSource;
+		while (length--) *pDestByte++ = *pSourceByte++;
+	}
+	else {
+		memcpy(pDest, pSource, length);
+	}
+}
+
+//returns pointer wrapped into the queue buffer, pointer must not exceed the buffer more than by its size
+static void * cq_wrapPointer(CQ_S *pQueue, void * pPtr) {
+	if (pPtr >= pQueue->pDataEnd) {
+		pPtr = (char*)pPtr - pQueue->totalSize;
+	}
+	return pPtr;
+}
+
+//copies data into the queue buffer by at most two block copies (split at the end of the buffer), returns pointer to the byte after copied data
 void * cq_wrappedCopyToBuff(CQ_S *pQueue, void * pStart, void * pSource, size_t length) {
-	size_t i = 0;
-	for (i = 0; i < length; ++i) {
-		*(char*)pStart = *(char*)pSource;
-		pStart = (char*)pStart + 1;
-		pSource = (char*)pSource + 1;
-		if (pStart >= pQueue->pDataEnd) pStart = pQueue->pDataBegin;
+	size_t tillEnd = (size_t)((char*)pQueue->pDataEnd - (char*)pStart);
+	if (pQueue->mirrored || (length <= tillEnd)) {
+		//most of copies (headers and scalar payloads) don't wrap, they take a single block copy
+		cq_copyBlock(pStart, pSource, length);
+		return cq_wrapPointer(pQueue, (char*)pStart + length);
 	}
-	return pStart;
+	cq_copyBlock(pStart, pSource, tillEnd);
+	cq_copyBlock(pQueue->pDataBegin, (const char*)pSource + tillEnd, length - tillEnd);
+	return (char*)pQueue->pDataBegin + (length - tillEnd);
 }
 
-//returns pointer to the next message in the circular buffer
+//copies data from the queue buffer by at most two block copies (split at the end of the buffer), returns pointer to the next message in the circular buffer
 void * cq_wrappedCopyFromBuff(CQ_S *pQueue, void * pStart, void * pDest, size_t length) {
-	size_t i = 0;
-	for (i = 0; i < length; ++i) {
-		*(char*)pDest = *(char*)pStart;
-		pStart = (char*)pStart + 1;
-		pDest = (char*)pDest + 1;
-		if (pStart >= pQueue->pDataEnd) pStart = pQueue->pDataBegin;
+	size_t tillEnd = (size_t)((char*)pQueue->pDataEnd - (char*)pStart);
+	if (pQueue->mirrored || (length <= tillEnd)) {
+		cq_copyBlock(pDest, pStart, length);
+		return cq_wrapPointer(pQueue, (char*)pStart + length);
 	}
-	return pStart;
+	cq_copyBlock(pDest, pStart, tillEnd);
+	cq_copyBlock((char*)pDest + tillEnd, pQueue->pDataBegin, length - tillEnd);
+	return (char*)pQueue->pDataBegin + (length - tillEnd);
 }
 
-bool cq_addTailElement(CQ_S *pQueue, void * pNewElement, size_t elementSize)
+bool cq_reserveTail(CQ_S *pQueue, size_t elementSize, CQ_REGION_S *pRegion)
 {
 	if (0 == elementSize) return false; //empty records are not allowed
+	if (elementSize > CQ_MAX_ELEM_SIZE) return false;
+	if (0 != pQueue->reservedSize) return false; //only one pending reservation is allowed
 	if (!cq_hasSpace(pQueue, elementSize))
 	{
 		PRINT_DEBUG_CQ("Queue Overflow\r\n");
 		return false;
 	}
-	else {
-		PRINT_DEBUG_CQ("Insert element %u ", pQueue->count + 1);
-		//build header
-		CQ_ELEM_HEADER_S header = { 0, };
-		header.size = elementSize;
-		//copy header and data into the data buffer of the queue and update queue info
-		void * pEnd = cq_wrappedCopyToBuff(pQueue, pQueue->pRear, (void*)&header, sizeof(header));
-		pQueue->pRear = cq_wrappedCopyToBuff(pQueue, (char*)pEnd, (char*)pNewElement, elementSize);
-		pQueue->count++;
-		pQueue->freeSize -= (elementSize + sizeof(header));
-		return true;
-	}
+	//element data starts right after its header, header itself will be written on commit
+	void * pData = cq_wrapPointer(pQueue, (char*)pQueue->pRear + sizeof(CQ_ELEM_HEADER_S));
+	cq_makeRegion(pQueue, pData, elementSize, pRegion);
+	pQueue->reservedSize = elementSize;
+	return true;
 }
 
-size_t cq_getFrontElement(CQ_S *pQueue, void * pDest, size_t destMaxSize)
+bool cq_commitTail(CQ_S *pQueue, size_t elementSize)
+{
+	if ((0 == pQueue->reservedSize) || (elementSize > pQueue->reservedSize)) return false;
+	pQueue->reservedSize = 0;
+	if (0 == elementSize) return false; //reservation is cancelled
+	PRINT_DEBUG_CQ("Insert element %u ", (unsigned)(pQueue->elemsIn + 1));
+	//build header
+	CQ_ELEM_HEADER_S header = { 0, };
+	header.size = (CQ_ELEM_SIZE_T)elementSize;
+	//copy header into the data buffer of the queue and update queue info
+	(void)cq_wrappedCopyToBuff(pQueue, pQueue->pRear, (void*)&header, sizeof(header));
+	pQueue->pRear = cq_wrapPointer(pQueue, (char*)pQueue->pRear + elementSize + sizeof(header));
+	//publish the element to consumer
+	CQ_STORE_RELEASE(pQueue->bytesIn, pQueue->bytesIn + elementSize + sizeof(header));
+	CQ_STORE_RELEASE(pQueue->elemsIn, pQueue->elemsIn + 1);
+	return true;
+}
+
+bool cq_addTailElement(CQ_S *pQueue, void * pNewElement, size_t elementSize)
+{
+	CQ_REGION_S region;
+	if (!cq_reserveTail(pQueue, elementSize, &region)) return false;
+	(void)cq_copyToRegion(&region, 0, pNewElement, elementSize);
+	return cq_commitTail(pQueue, elementSize);
+}
+
+void cq_cursorInit(CQ_S *pQueue, CQ_CURSOR_S *pCursor)
+{
+	pCursor->pElement = pQueue->pFront;
+	pCursor->index = 0;
+}
+
+size_t cq_cursorNext(CQ_S *pQueue, CQ_CURSOR_S *pCursor, CQ_REGION_S *pRegion)
 {
 	CQ_ELEM_HEADER_S header;
 	void * pData;
-	size_t bytesToRead = 0;
-	if (pQueue->count > 0)
+	if ((CQ_LOAD_ACQUIRE(pQueue->elemsIn) - pQueue->elemsOut) > pCursor->index)
 	{
-		pData = cq_wrappedCopyFromBuff(pQueue, pQueue->pFront, (void*)&header, sizeof(header));
-		bytesToRead = header.size;
-		if (destMaxSize < header.size) bytesToRead = destMaxSize;
-		(void)cq_wrappedCopyFromBuff(pQueue, (void*)pData, (void*)pDest, bytesToRead);
-		return bytesToRead;
+		pData = cq_wrappedCopyFromBuff(pQueue, pCursor->pElement, (void*)&header, sizeof(header));
+		cq_makeRegion(pQueue, pData, header.size, pRegion);
+		pCursor->pElement = cq_wrapPointer(pQueue, (char*)pData + header.size);
+		pCursor->index++;
+		return header.size;
 	}
 	else {
-		//queue is empty
+		//no more elements
 		return 0;
 	}
 }
 
+size_t cq_peekFront(CQ_S *pQueue, CQ_REGION_S *pRegion)
+{
+	CQ_CURSOR_S cursor;
+	cq_cursorInit(pQueue, &cursor);
+	return cq_cursorNext(pQueue, &cursor, pRegion);
+}
+
+size_t cq_getFrontElement(CQ_S *pQueue, void * pDest, size_t destMaxSize)
+{
+	CQ_REGION_S region;
+	size_t bytesToRead = cq_peekFront(pQueue, &region);
+	if (destMaxSize < bytesToRead) bytesToRead = destMaxSize;
+	(void)cq_copyFromRegion(&region, 0, pDest, bytesToRead);
+	return bytesToRead;
+}
+
+size_t cq_deleteFrontElements(CQ_S *pQueue, size_t count)
+{
+	CQ_ELEM_HEADER_S header;
+	size_t available = CQ_LOAD_ACQUIRE(pQueue->elemsIn) - pQueue->elemsOut;
+	size_t bytes = 0;
+	if (count > available) count = available;
+	for (size_t i = 0; i < count; i++) {
+		(void)cq_wrappedCopyFromBuff(pQueue, pQueue->pFront, (char*)&header, sizeof(header));
+		pQueue->pFront = cq_wrapPointer(pQueue, (char*)pQueue->pFront + header.size + sizeof(header));
+		bytes += header.size + sizeof(header);
+	}
+	if (count > 0) {
+		//give the space back to producer by single update
+		CQ_STORE_RELEASE(pQueue->elemsOut, pQueue->elemsOut + count);
+		CQ_STORE_RELEASE(pQueue->bytesOut, pQueue->bytesOut + bytes);
+	}
+	return count;
+}
+
 size_t cq_deleteFrontElement(CQ_S *pQueue)
 {
 	CQ_ELEM_HEADER_S header;
-	if (pQueue->count > 0)
+	if (CQ_LOAD_ACQUIRE(pQueue->elemsIn) != pQueue->elemsOut)
 	{
 		(void)cq_wrappedCopyFromBuff(pQueue, pQueue->pFront, (char*)&header, sizeof(header));
-		void * pvTemp = (char*)pQueue->pFront + header.size + sizeof(header);
-		if (pvTemp >= pQueue->pDataEnd) {
-			pvTemp = (char*)pvTemp - pQueue->totalSize;
-		}
-		pQueue->pFront = pvTemp;
-		pQueue->count--;
-		pQueue->freeSize += (header.size + sizeof(header));
+		(void)cq_deleteFrontElements(pQueue, 1);
 		return header.size;
 	}
 	else {
@@ -135,6 +371,26 @@ size_t cq_deleteFrontElement(CQ_S *pQueue)
 	}
 }
 
+size_t cq_deleteElement(CQ_S *pQueue, const CQ_CURSOR_S *pCursor)
+{
+	CQ_ELEM_HEADER_S header;
+	if ((CQ_LOAD_ACQUIRE(pQueue->elemsIn) - pQueue->elemsOut) <= pCursor->index) return 0;
+	(void)cq_wrappedCopyFromBuff(pQueue, pCursor->pElement, (char*)&header, sizeof(header));
+	size_t elemBytes = header.size + sizeof(header);
+	//shift elements before the removed one over it starting from the last byte, so the space is freed at the front
+	size_t frontOffset = (size_t)((char*)pQueue->pFront - (char*)pQueue->pDataBegin);
+	size_t bytesBefore = (size_t)((char*)pCursor->pElement - (char*)pQueue->pFront);
+	if (pCursor->pElement < pQueue->pFront) bytesBefore += pQueue->totalSize;
+	char * pBuffer = (char*)pQueue->pDataBegin;
+	for (size_t i = bytesBefore; i > 0; i--) {
+		pBuffer[(frontOffset + i - 1 + elemBytes) % pQueue->totalSize] = pBuffer[(frontOffset + i - 1) % pQueue->totalSize];
+	}
+	pQueue->pFront = cq_wrapPointer(pQueue, (char*)pQueue->pFront + elemBytes);
+	CQ_STORE_RELEASE(pQueue->elemsOut, pQueue->elemsOut + 1);
+	CQ_STORE_RELEASE(pQueue->bytesOut, pQueue->bytesOut + elemBytes);
+	return header.size;
+}
+
 int cq_count(CQ_S *pQueue) {
-	return pQueue->count;
+	return (int)(CQ_LOAD_ACQUIRE(pQueue->elemsIn) - CQ_LOAD_ACQUIRE(pQueue->elemsOut));
 }
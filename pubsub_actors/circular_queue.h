@@ -6,7 +6,8 @@
   Copyright   : Copyright (c) 2023, Valerii Proskurin. All rights reserved.
   Description : This file contains API functions prototypes for circular FIFO queue with
   elements of variable size located in a statically allocated array. Not thread safe!
-  Must be called ONLY from safe section to avoid queue corruption.
+  Must be called ONLY from safe section to avoid queue corruption. If CQ_CFG_LOCK_FREE_SPSC
+  is enabled one producer and one consumer can access the queue concurrently without locks.
   License     : SPDX-License-Identifier: GPL-3.0-or-later OR commercial.
   This program is free software: you can redistribute it and/or modify
   it under the terms of the GNU General Public License as published by
@@ -40,12 +41,37 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+//enables lock-free single-producer/single-consumer mode: producer (cq_reserveTail/cq_commitTail/cq_addTailElement)
+//and consumer (cq_peekFront/cq_getFrontElement/cq_deleteFrontElement) can run concurrently in different contexts (ISR/thread).
+#ifndef CQ_CFG_LOCK_FREE_SPSC
+#define CQ_CFG_LOCK_FREE_SPSC	(0)
+#endif
+
+//enables cq_initMirrored() (hosted Linux only): queue buffer is mapped twice back to back in virtual memory,
+//so every element is contiguous and can be copied by single memcpy or accessed directly.
+#ifndef CQ_CFG_MIRRORED_BUFFER
+#define CQ_CFG_MIRRORED_BUFFER	(0)
+#endif
+
+//enables compact element header: element size is stored as 16 bit value instead of size_t, so elements are limited to 65535 bytes.
+#ifndef CQ_CFG_COMPACT_ELEM_HEADER
+#define CQ_CFG_COMPACT_ELEM_HEADER	(1)
+#endif
+
+#if CQ_CFG_COMPACT_ELEM_HEADER
+typedef uint16_t CQ_ELEM_SIZE_T;
+#define CQ_MAX_ELEM_SIZE	(UINT16_MAX)
+#else
+typedef size_t CQ_ELEM_SIZE_T;
+#define CQ_MAX_ELEM_SIZE	(SIZE_MAX)
+#endif
+
 /**
  * Struct that defines element's header.
  */
 typedef struct _CQ_ELEM_HEADER_S
 {
-	size_t size; //element size in bytes
+	CQ_ELEM_SIZE_T size; //element size in bytes
 } CQ_ELEM_HEADER_S;
 
 /**
@@ -56,12 +82,36 @@ typedef struct _CQ_S
 	void * pDataBegin; //pointer to static array which will be used to store all data.
 	void * pDataEnd;
 	size_t totalSize;   //total buffer size in bytes
-	void * pRear; //pointer to the rear element
-	void * pFront; //pointer to the front element
-	size_t freeSize; //number of free bytes in the buffer
-	int count; //number of elements in the queue
+	void * pRear; //pointer to the rear element (owned by producer)
+	void * pFront; //pointer to the front element (owned by consumer)
+	size_t bytesIn; //running count of bytes added to the queue (owned by producer)
+	size_t bytesOut; //running count of bytes removed from the queue (owned by consumer)
+	size_t elemsIn; //running count of elements added to the queue (owned by producer)
+	size_t elemsOut; //running count of elements removed from the queue (owned by consumer)
+	size_t reservedSize; //size of the pending (reserved but not committed) tail element, 0 if there is no reservation
+	bool mirrored; //buffer is followed by its mirror mapping, so elements never wrap
 } CQ_S;
 
+/**
+ * Struct that describes a region of the queue buffer. Region can be split in two parts if it crosses the end of the buffer.
+ */
+typedef struct _CQ_REGION_S
+{
+	void * pFirst; //pointer to the first part of the region
+	size_t firstSize; //size of the first part in bytes
+	void * pSecond; //pointer to the second (wrapped) part of the region, NULL if region doesn't wrap
+	size_t secondSize; //size of the second part in bytes
+} CQ_REGION_S;
+
+/**
+ * Struct that defines position of an element in the queue, used to walk through elements without removing them.
+ */
+typedef struct _CQ_CURSOR_S
+{
+	void * pElement; //pointer to the element header in the queue buffer
+	size_t index; //index of the element counting from the front of the queue
+} CQ_CURSOR_S;
+
 /**
  * @brief Initializes FIFO queue with parameters of its buffer array and element size.
  * @param pQueue pointer to CQ_S variable to be initialized.
@@ -70,6 +120,22 @@ typedef struct _CQ_S
  */
 void cq_init(CQ_S *pQueue, void * qBuffer, size_t qBufferSize);
 
+#if CQ_CFG_MIRRORED_BUFFER
+/**
+ * @brief Initializes FIFO queue with a buffer mapped twice back to back in virtual memory (memfd + mmap).
+ * @param pQueue pointer to CQ_S variable to be initialized.
+ * @param qBufferSize size of the buffer in bytes, rounded up to the page size.
+ * @return true if success, otherwise - false (mapping failed).
+ */
+bool cq_initMirrored(CQ_S *pQueue, size_t qBufferSize);
+
+/**
+ * @brief releases buffer of the queue initialized by cq_initMirrored().
+ * @param pQueue pointer to the queue.
+ */
+void cq_deinitMirrored(CQ_S *pQueue);
+#endif
+
 /**
  * @brief removes head element from the CQ.
  * @param pQueue pointer to the queue.
@@ -77,6 +143,23 @@ void cq_init(CQ_S *pQueue, void * qBuffer, size_t qBufferSize);
  */
 size_t cq_deleteFrontElement(CQ_S *pQueue);
 
+/**
+ * @brief removes several head elements from the CQ at once (typically after they were processed via cursor).
+ * @param pQueue pointer to the queue.
+ * @param count number of elements to remove.
+ * @return number of removed elements.
+ */
+size_t cq_deleteFrontElements(CQ_S *pQueue, size_t count);
+
+/**
+ * @brief removes the element pointed by the cursor (the one cq_cursorNext() returns next), elements before it are moved towards the tail.
+ * Consumer side operation, it costs copying of the elements before the removed one, so it's intended for rare cases like queue overflow.
+ * @param pQueue pointer to the queue.
+ * @param pCursor position of the element, other cursors of the queue become invalid.
+ * @return length of the removed data in bytes if success, otherwise - 0.
+ */
+size_t cq_deleteElement(CQ_S *pQueue, const CQ_CURSOR_S *pCursor);
+
 /**
  * @brief copies head element from the CQ into destination buffer.
  * @param pQueue pointer to queue.
@@ -86,6 +169,31 @@ size_t cq_deleteFrontElement(CQ_S *pQueue);
  */
 size_t cq_getFrontElement(CQ_S *pQueue, void * pDest, size_t destMaxSize);
 
+/**
+ * @brief gives access to the head element data directly in the queue buffer without copying it. Element stays in the queue
+ * and region remains valid until the element is removed by cq_deleteFrontElement().
+ * @param pQueue pointer to queue.
+ * @param pRegion pointer to region struct that will be filled with one or two (if wrapped) spans of the element data.
+ * @return length of the element data in bytes if success, otherwise - 0.
+ */
+size_t cq_peekFront(CQ_S *pQueue, CQ_REGION_S *pRegion);
+
+/**
+ * @brief sets cursor to the head element of the queue.
+ * @param pQueue pointer to queue.
+ * @param pCursor pointer to the cursor to be initialized.
+ */
+void cq_cursorInit(CQ_S *pQueue, CQ_CURSOR_S *pCursor);
+
+/**
+ * @brief gives access to the element under the cursor directly in the queue buffer (like cq_peekFront()) and moves cursor to the next element.
+ * @param pQueue pointer to queue.
+ * @param pCursor pointer to the cursor initialized by cq_cursorInit().
+ * @param pRegion pointer to region struct that will be filled with one or two (if wrapped) spans of the element data.
+ * @return length of the element data in bytes if success, 0 - if there are no more elements.
+ */
+size_t cq_cursorNext(CQ_S *pQueue, CQ_CURSOR_S *pCursor, CQ_REGION_S *pRegion);
+
 /**
  * @brief adds tail element to the CQ by copying an element to queue's internal buffer.
  * @param pQueue pointer to the queue
@@ -95,6 +203,52 @@ size_t cq_getFrontElement(CQ_S *pQueue, void * pDest, size_t destMaxSize);
  */
 bool cq_addTailElement(CQ_S *pQueue, void * pNewElement, size_t elementSize);
 
+/**
+ * @brief reserves space for a tail element and returns writable region for its data, so producer can build element directly in the queue buffer.
+ * Reserved element is invisible for consumer until cq_commitTail() is called. Only one reservation per queue can be pending.
+ * @param pQueue pointer to the queue
+ * @param elementSize max length of the element to be added in the queue (bytes).
+ * @param pRegion pointer to region struct that will be filled with one or two (if wrapped) spans of the reserved space.
+ * @return true if success, otherwise - false (queue is full, element exceeds CQ_MAX_ELEM_SIZE or another reservation is pending).
+ */
+bool cq_reserveTail(CQ_S *pQueue, size_t elementSize, CQ_REGION_S *pRegion);
+
+/**
+ * @brief commits element reserved by cq_reserveTail() and makes it available for consumer.
+ * @param pQueue pointer to the queue
+ * @param elementSize actual length of the element (bytes), must not exceed reserved size. 0 cancels the reservation.
+ * @return true if element was added, otherwise - false.
+ */
+bool cq_commitTail(CQ_S *pQueue, size_t elementSize);
+
+/**
+ * @brief copies data into a region of the queue buffer taking care about its wrapped part.
+ * @param pRegion pointer to the region.
+ * @param offset offset inside of the region (bytes).
+ * @param pSource pointer to the data to be copied.
+ * @param length number of bytes to copy.
+ * @return true if success, false if data doesn't fit in the region.
+ */
+bool cq_copyToRegion(const CQ_REGION_S *pRegion, size_t offset, const void * pSource, size_t length);
+
+/**
+ * @brief copies data from a region of the queue buffer taking care about its wrapped part.
+ * @param pRegion pointer to the region.
+ * @param offset offset inside of the region (bytes).
+ * @param pDest pointer to the destination buffer.
+ * @param length number of bytes to copy.
+ * @return true if success, false if requested data is out of the region.
+ */
+bool cq_copyFromRegion(const CQ_REGION_S *pRegion, size_t offset, void * pDest, size_t length);
+
+/**
+ * @brief makes a sub-region that starts at specific offset of the source region.
+ * @param pRegion pointer to the source region.
+ * @param offset offset inside of the source region (bytes), must not exceed its size.
+ * @param pSubRegion pointer to the region struct to be filled.
+ */
+void cq_subRegion(const CQ_REGION_S *pRegion, size_t offset, CQ_REGION_S *pSubRegion);
+
 /**
  * @brief returns number of the elements in the queue.
  * @param pQueue pointer to queue.
@@ -102,6 +256,13 @@ bool cq_addTailElement(CQ_S *pQueue, void * pNewElement, size_t elementSize);
  */
 int cq_count(CQ_S *pQueue);
 
+/**
+ * @brief returns number of bytes taken by the elements of the queue (including their headers).
+ * @param pQueue pointer to queue.
+ * @return used space in bytes.
+ */
+size_t cq_usedSpace(CQ_S *pQueue);
+
 /**
  * @brief checks if the queue has enough space to hold the element of specific size.
  * @param pQueue pointer to queue.
@@ -111,7 +272,7 @@ int cq_count(CQ_S *pQueue);
 bool cq_hasSpace(CQ_S *pQueue, size_t elementSize);
 
 /**
- * @brief clears content of the queue.
+ * @brief clears content of the queue. Must not be called concurrently with producer or consumer.
  * @param pQueue pointer to the queue
  */
 void cq_flush(CQ_S *pQueue);
@@ -31,163 +31,1017 @@ please contact author via easyvolts@gmail.com for licensing options.
 #include "pubsub.h"
 #include "circular_queue.h"
 #include <string.h>
+#if PS_PRODUCER_QUEUES_COUNT || CQ_CFG_LOCK_FREE_SPSC
+#include <atomic>
+#endif
+#if PS_PRODUCER_QUEUES_COUNT
+#include <thread>
+#include <chrono>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
-typedef uint16_t PsActorId_t;
+typedef uint8_t PsActorId_t;
+typedef uint32_t PsActorSet_t; //bit per actor id
+typedef uint16_t PsNodeId_t;
+#if (PS_TOPIC_SEGMENTS_POOL_SIZE > 0xFFFF)
+typedef uint32_t PsSegmentOffset_t;
+#else
+typedef uint16_t PsSegmentOffset_t;
+#endif
+typedef uint16_t PsPoolBlock_t; //offset of the block in the payload pool (in pool words)
+typedef uint16_t PsLoanBlock_t;
+typedef uint16_t PsTimerId_t;
 
-//header part of IPC messages (actor mail header).
+//header part of IPC messages (actor mail header). Payload length is not stored, in the queue it's derived from the element size.
 typedef struct _PsMsgStructHdr_s {
 	PsTopicHash_t xTopicHash;
-	PsMsgLen_t xMsgLen;
 } PsMsgStructHdr_s;
 
-typedef struct _PsMsgStruct_s {
-	PsMsgStructHdr_s xHdr;
-	uint8_t  pu8Data[PS_MAX_MESSAGE_PAYLOAD_LENGTH];
-} PsMsgStruct_s;
+//header of the payload pool block, payload follows it. Blocks consist of whole pool words, so every payload is aligned for any data type.
+typedef struct _PsPoolBlockHdrStruct_s {
+	uint16_t u16Words; //size of the block including its header
+	uint8_t u8Used;
+	PsMsgLen_t xMsgLen; //length of the payload stored in the block
+} PsPoolBlockHdrStruct_s;
+
+typedef union _PsPoolWordUnion_u {
+	uint64_t u64Data;
+	PsPoolBlockHdrStruct_s xHdr;
+} PsPoolWordUnion_u;
+
+//loaned buffer referenced by the message, queue carries it instead of the payload.
+typedef struct _PsLoanRefStruct_s {
+	PsLoanBlock_t xBlock;
+	PsMsgLen_t xMsgLen;
+} PsLoanRefStruct_s;
 
+//topic data used on every publishing and dispatching, kept small so the table stays dense in cache.
 typedef struct _PsTopicStruct_s {
-	PsTopicHash_t u16Hash;
+	PsNodeId_t xNode; //node of the topics tree where the topic path ends, root node if the topic slot is free
+	uint8_t u8Priority; //priority class, index of the message queue of the publisher
+	uint8_t u8Conflate_flag; //only the latest value waits in the queue
 	PsDataType_e xDtype;
 	uint8_t u8Sticky_flag;
-	char pu8TopicPathStr[PS_MAX_TOPIC_PATH_STR_LENGTH];
-	char pu8TopicInfoStr[PS_MAX_TOPIC_INFO_STR_LENGTH];
-	actor_f pxSubscribers[PS_MAX_ACTORS_COUNT];
-	actor_f pxPublishers[PS_MAX_ACTORS_COUNT];
-	uint8_t u8PublishersMute[PS_MAX_ACTORS_COUNT];
-	PsMsgStruct_s xLastMsg;
+	uint8_t u8Inline_flag; //subscribers are called synchronously by the publisher
+	PsMsgLen_t xMaxMsgLen; //payload capacity declared by the first publisher
+	PsActorSet_t xSubscribers; //fan-out set (explicit and wildcard subscribers), wildcard subscriptions are resolved into it when the topic is created
+	PsActorSet_t xPublishers;
+	PsActorSet_t xPublishersMute;
 } PsTopicStruct_s;
 
+//topic data used on registration and for "sticky" topics only, lives in a parallel array indexed by the topic hash.
+typedef struct _PsTopicColdStruct_s {
+	PsActorSet_t xExplicitSubscribers; //subscribed by the exact topic path
+	PsActorSet_t xWildcardSubscribers; //subscribed by one or more wildcard patterns
+	char pu8TopicInfoStr[PS_MAX_TOPIC_INFO_STR_LENGTH];
+	PsPoolBlock_t xStickyBlock; //last value in the payload pool, valid if the topic is "sticky"
+	PsPoolBlock_t xPendingBlock; //value of the conflating topic waiting in the queue, newer values overwrite it, PS_POOL_BLOCK_NONE if there is no such value
+	uint8_t u8PendingPosted; //message of xPendingBlock is in the queue, till then the block belongs to its publisher
+	uint8_t u8OverflowPolicy; //PsOverflowPolicy_e
+	uint16_t u16BlockTimeoutMs; //max wait of PS_OVERFLOW_BLOCK
+	PsTimerId_t xTimer; //timer of the timer topic, PS_TIMER_NONE for other topics
+} PsTopicColdStruct_s;
+
+//short message (scalar value) assembled on the stack and posted into the queue by a single write.
+typedef struct _PsShortMsgStruct_s {
+	PsMsgStructHdr_s xHdr;
+	uint8_t pu8Data[sizeof(uint64_t)];
+} PsShortMsgStruct_s;
+
+//state of the message reserved by ps_pub_topic_reserve() and waiting for ps_pub_topic_commit().
+typedef struct _PsPubReservationStruct_s {
+	uint8_t u8Pending;
+	uint8_t u8Muted; //muted messages are written into a scratch buffer and are not posted into the queue.
+	uint8_t u8Conflated; //value of the conflating topic, it's written aside and the queue isn't reserved
+	PsTopicHash_t xTopicHash;
+	PsMsgLen_t xMaxMsgLen;
+	PsPoolBlock_t xBlock; //payload pool block of the long message, PS_POOL_BLOCK_NONE if payload is inline
+	CQ_S * pxQueue;
+	CQ_REGION_S xMsgRegion; //complete message (header + payload) in the queue buffer
+	CQ_REGION_S xPayloadRegion;
+	uint8_t pu8MsgScratch[PS_MAX_MESSAGE_PAYLOAD_LENGTH]; //payload of muted message or short value of the conflating topic
+} PsPubReservationStruct_s;
+
+//node of the topics tree, it holds one segment of the topic path (part between dots), so common path prefixes are stored only once.
+typedef struct _PsTopicNodeStruct_s {
+	PsSegmentOffset_t xSegmentOffset; //segment chars (without terminating zero) in the segments pool
+	uint8_t u8SegmentLen;
+	PsNodeId_t xParent;
+	PsNodeId_t xFirstChild;
+	PsNodeId_t xNextSibling;
+	PsTopicHash_t xTopicHash; //topic which path ends at this node, PS_TOPIC_NONE if there is no such topic
+} PsTopicNodeStruct_s;
+
+//wildcard subscription, actor is subscribed to every existing and future topic matching the pattern.
+typedef struct _PsWildcardSubStruct_s {
+	char pu8TopicPatternStr[PS_MAX_TOPIC_PATH_STR_LENGTH];
+	actor_f pxActorHandler; //NULL if the slot is free
+} PsWildcardSubStruct_s;
+
+//state of subscribing/unsubscribing the wildcard to existing topics.
+typedef struct _PsWildcardVisitStruct_s {
+	const char * pu8TopicPatternStr;
+	actor_f pxActorHandler;
+	uint8_t u8SubscribeFlag;
+	PsResultType_e xResult;
+} PsWildcardVisitStruct_s;
+
+//timer of the timer topic, it's linked into the list of its timer wheel slot.
 typedef struct _PsTimerStruct_s {
 	PsTopicHash_t u16Hash;
 	actor_f xCreatorPublisher; //only one topic creating publisher is allowed (but for debug we can inject timer events from other publishers).
-	long int duration_ms;
-	long int time_left_ms;
-	uint8_t periodic_flag;
+	uint32_t u32Period_ms; //0 - single shot timer
+	uint64_t u64Expiry_ms; //absolute time of the timer wheel
+	PsTimerId_t xNext;
+	PsTimerId_t xPrev;
+	uint8_t u8Slot; //list of the timer: wheel slot (level * PS_TIMER_WHEEL_SLOTS + slot of the level), PS_TIMER_SLOT_DUE or PS_TIMER_SLOT_NONE
 } PsTimerStruct_s;
 
 //*********** private function prototypes
 PsResultType_e ps_pub_topic(PsTopicHash_t xTopicHash, PsMsgLen_t xMsgLen, void * pvData);
+void * ps_map_msg_payload(const CQ_REGION_S * pxMsgRegion, PsMsgLen_t xMsgLen, PsDataType_e xDataType, void * pvCopyBuf);
+#if PS_LOAN_BLOCKS_COUNT
+void ps_unref_loan_block(PsLoanBlock_t xBlock);
+#endif
+void ps_timer_free(PsTimerId_t xTimer);
+PsResultType_e ps_manage_topic(PsTopicHash_t xTopicHash);
+
+#if (PS_TOPIC_NODES_INDEX_SIZE & (PS_TOPIC_NODES_INDEX_SIZE - 1)) || (PS_TOPIC_NODES_INDEX_SIZE <= PS_MAX_TOPIC_NODES_COUNT) || (PS_MAX_TOPIC_NODES_COUNT >= 0xFFFF)
+#error "PS_TOPIC_NODES_INDEX_SIZE must be power of 2 and greater than PS_MAX_TOPIC_NODES_COUNT"
+#endif
+#if (PS_MAX_TOPICS_COUNT >= 0xFFFF)
+#error "PS_MAX_TOPICS_COUNT is too big"
+#endif
+#if (PS_MAX_TOPIC_PATH_STR_LENGTH > 256)
+#error "PS_MAX_TOPIC_PATH_STR_LENGTH is too big"
+#endif
+#define PS_TOPIC_NONE			((PsTopicHash_t)0xFFFF)
+#define PS_TOPIC_NODE_NONE		((PsNodeId_t)0xFFFF)
+#define PS_TOPIC_NODE_ROOT		((PsNodeId_t)0)
+#define PS_SUB_FLAG_EXPLICIT	(1)
+#define PS_SUB_FLAG_WILDCARD	(2)
+#if (PS_ACTORS_INDEX_SIZE & (PS_ACTORS_INDEX_SIZE - 1)) || (PS_ACTORS_INDEX_SIZE <= PS_MAX_ACTORS_COUNT) || (PS_ACTORS_INDEX_SIZE > 0xFFFF)
+#error "PS_ACTORS_INDEX_SIZE must be power of 2 and greater than PS_MAX_ACTORS_COUNT"
+#endif
+#if (PS_MAX_ACTORS_COUNT < 1) || (PS_MAX_ACTORS_COUNT > 32)
+#error "PS_MAX_ACTORS_COUNT must be in range 1..32, it's limited by the width of PsActorSet_t"
+#endif
+#if (PS_MAX_TOPICS_COUNT >= 0x4000)
+#error "PS_MAX_TOPICS_COUNT is too big, two highest bits of the topic hash in the message header mark payloads kept out of the queue"
+#endif
+#define PS_MSG_FLAG_POOLED		((PsTopicHash_t)0x8000) //queue carries only PsPoolBlock_t of the payload
+#define PS_MSG_FLAG_LOANED		((PsTopicHash_t)0x4000) //queue carries only PsLoanRefStruct_s of the loaned buffer
+#define PS_POOL_WORDS			((PS_PAYLOAD_POOL_SIZE + 7) / 8) //pool word is uint64_t
+#if (PS_POOL_WORDS < 2) || (PS_POOL_WORDS > 0xFFFF)
+#error "PS_PAYLOAD_POOL_SIZE is out of range"
+#endif
+#define PS_POOL_BLOCK_NONE		((PsPoolBlock_t)0xFFFF)
+#define PS_POOL_MAX_PAYLOAD		((PS_POOL_WORDS - 1) * sizeof(uint64_t)) //payload of the single block taking the whole pool
+#define PS_LOAN_BLOCK_NONE		((PsLoanBlock_t)0xFFFF)
+#if (PS_LOAN_BLOCKS_COUNT >= 0xFFFF) || (PS_LOAN_BLOCK_SIZE > 0xFFFF)
+#error "PS_LOAN_BLOCKS_COUNT or PS_LOAN_BLOCK_SIZE is too big"
+#endif
+#define PS_ACTOR_NONE			((PsActorId_t)0xFF)
+#define PS_ACTOR_BIT(id)		((PsActorSet_t)1 << (id))
+#if (PS_TIMER_WHEEL_LEVELS < 1) || (PS_TIMER_WHEEL_LEVELS > 6) || (PS_MAX_TIMERS_COUNT >= 0xFFFF)
+#error "PS_TIMER_WHEEL_LEVELS must be 1..6 and PS_MAX_TIMERS_COUNT less than 0xFFFF"
+#endif
+#define PS_TIMER_NONE			((PsTimerId_t)0xFFFF)
+#define PS_TIMER_WHEEL_BITS		(5) //32 slots per level, so non-empty slots of the level fit into uint32_t
+#define PS_TIMER_WHEEL_SLOTS	(1 << PS_TIMER_WHEEL_BITS)
+#define PS_TIMER_WHEEL_MASK		(PS_TIMER_WHEEL_SLOTS - 1)
+#define PS_TIMER_WHEEL_MAX_MS	(((uint64_t)1 << (PS_TIMER_WHEEL_BITS * PS_TIMER_WHEEL_LEVELS)) - 1)
+#define PS_TIMER_SLOT_DUE		(PS_TIMER_WHEEL_LEVELS * PS_TIMER_WHEEL_SLOTS) //timers collected from the wheel for expiring or moving to a lower level
+#define PS_TIMER_SLOT_NONE		(0xFF) //timer isn't scheduled (single shot timer has expired)
+#define PS_IDLE_AWAKE			(0)
+#define PS_IDLE_SLEEPING		(1) //ps_idle() checks queues or sleeps
+#define PS_IDLE_CANCELLED		(2) //message was posted while ps_idle() was sleeping
 
 static PsTopicStruct_s TopicsArray[PS_MAX_TOPICS_COUNT] = { 0, };
-static PsTimerStruct_s TimersArray[PS_MAX_TOPICS_COUNT] = { 0, };
-static CQ_S msg_queue = { 0 };
-static uint8_t msg_queue_buf[1024] = { 0, };
+static PsTopicColdStruct_s TopicsColdArray[PS_MAX_TOPICS_COUNT] = { 0, };
+static PsTopicHash_t TopicsFreeList[PS_MAX_TOPICS_COUNT]; //stack of free topic slots
+static PsTopicHash_t xTopicsFreeCount = 0;
+static PsPoolWordUnion_u PayloadPool[PS_POOL_WORDS]; //blocks follow each other from the pool start, free neighbours are merged on allocation
+#if PS_LOAN_BLOCKS_COUNT
+static uint64_t LoanBlocksArray[PS_LOAN_BLOCKS_COUNT][(PS_LOAN_BLOCK_SIZE + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+static uint8_t LoanRefsArray[PS_LOAN_BLOCKS_COUNT]; //owners of the block (publisher, queued messages, retaining subscribers), 0 - block is free
+static PsLoanBlock_t LoanFreeList[PS_LOAN_BLOCKS_COUNT]; //stack of free blocks
+static PsLoanBlock_t xLoanFreeCount = 0;
+#endif
+static PsTopicNodeStruct_s TopicNodesArray[PS_MAX_TOPIC_NODES_COUNT];
+static PsNodeId_t TopicNodesIndex[PS_TOPIC_NODES_INDEX_SIZE]; //open addressing (linear probing) hash index: parent node + segment -> child node
+static PsNodeId_t TopicNodesFreeList[PS_MAX_TOPIC_NODES_COUNT]; //stack of free tree nodes
+static PsNodeId_t xTopicNodesFreeCount = 0;
+static char TopicSegmentsPool[PS_TOPIC_SEGMENTS_POOL_SIZE]; //segments of tree nodes follow each other without holes
+static PsSegmentOffset_t xTopicSegmentsPoolUsed = 0;
+static PsWildcardSubStruct_s WildcardSubsArray[PS_MAX_WILDCARD_SUBS_COUNT];
+static actor_f ActorsArray[PS_MAX_ACTORS_COUNT]; //actor id is index in the array, ids are not reused (actors are functions, their count is known)
+static PsActorId_t ActorsIndex[PS_ACTORS_INDEX_SIZE]; //open addressing (linear probing) hash index: actor -> actor id
+static PsActorId_t xActorsCount = 0;
+static PsTimerStruct_s TimersArray[PS_MAX_TIMERS_COUNT];
+static PsTimerId_t TimersFreeList[PS_MAX_TIMERS_COUNT]; //stack of free timers
+static PsTimerId_t xTimersFreeCount = 0;
+static PsTimerId_t TimerSlotsArray[PS_TIMER_SLOT_DUE + 1]; //first timers of the lists of wheel slots and of the list of due timers
+static uint32_t TimerPendingSlots[PS_TIMER_WHEEL_LEVELS]; //bit per non-empty slot of the level
+static uint32_t TimerSlotsExpiry[PS_TIMER_SLOT_DUE]; //earliest expiry in the slot (low 32 bits), may be earlier after its timer is cancelled
+static uint64_t u64TimerWheelNow_ms = 0;
+static long int lTimerTickConsumed_ms = 0; //part of get_timer_tick_ms() already added to the wheel time since the last restart_timer() call
+static long int lTimerDeadline_ms = -1; //timeout of the last restart_timer() call, -1 if there are no timers
+#if PS_PRODUCER_QUEUES_COUNT
+#if !CQ_CFG_LOCK_FREE_SPSC
+#error "PS_PRODUCER_QUEUES_COUNT requires CQ_CFG_LOCK_FREE_SPSC"
+#endif
+#define PS_MSG_QUEUES_COUNT		(PS_PRODUCER_QUEUES_COUNT)
+#define PS_THREAD_LOCAL			thread_local
+//messages of different producers meet only in ps_loop(), so "sticky" values are updated on dispatch
+#define PS_STICKY_ON_DISPATCH	(1)
+#if (PS_PRODUCER_QUEUES_COUNT > 32)
+#error "PS_PRODUCER_QUEUES_COUNT is limited by the width of the claimed queues set"
+#endif
+#define PS_PRODUCER_QUEUES_MASK	((uint32_t)(((uint64_t)1 << PS_PRODUCER_QUEUES_COUNT) - 1))
+static std::atomic<uint32_t> xProducerQueuesClaimed(0); //bit per producer queue owned by a thread
+static std::atomic<uint32_t> xProducerQueuesEpoch(0); //incremented by ps_init(), queues claimed before it are claimed again
+static PS_THREAD_LOCAL CQ_S * pxThreadMsgQueue = NULL;
+static PS_THREAD_LOCAL uint32_t u32ThreadQueueEpoch = 0;
+static PS_THREAD_LOCAL uint8_t u8LoopThreadFlag = 0; //the thread calls ps_loop(), nobody else drains the queues while it waits for space
+//releases queue of the thread when the thread exits
+struct PsThreadQueueGuard_s {
+	~PsThreadQueueGuard_s() { ps_release_producer_queue(); }
+};
+static thread_local PsThreadQueueGuard_s xThreadQueueGuard;
+//payload pool and loaned buffers are shared by producer threads and ps_loop(), their operations are short, so spinning is enough
+static std::atomic_flag xPayloadPoolLock = ATOMIC_FLAG_INIT;
+#define PS_POOL_LOCK()			while (xPayloadPoolLock.test_and_set(std::memory_order_acquire)) {}
+#define PS_POOL_UNLOCK()		xPayloadPoolLock.clear(std::memory_order_release)
+#else
+#define PS_MSG_QUEUES_COUNT		(1)
+#define PS_THREAD_LOCAL
+#define PS_STICKY_ON_DISPATCH	(0)
+#define PS_POOL_LOCK()
+#define PS_POOL_UNLOCK()
+#endif
+#if (PS_PRIORITY_LEVELS_COUNT < 1) || (PS_PRIORITY_LEVELS_COUNT > 4)
+#error "PS_PRIORITY_LEVELS_COUNT must be in range 1..4"
+#endif
+#define PS_PRIORITY_LEVEL_BUF_SIZE(level)	(((level) < PS_PRIORITY_LEVELS_COUNT) ? PS_PRIORITY_QUEUE_BUF_SIZE(level) : 0)
+#define PS_PRIORITY_BUFS_SIZE	(PS_PRIORITY_LEVEL_BUF_SIZE(0) + PS_PRIORITY_LEVEL_BUF_SIZE(1) + PS_PRIORITY_LEVEL_BUF_SIZE(2) + PS_PRIORITY_LEVEL_BUF_SIZE(3))
+//queues of the producer go one after another starting from the lowest priority class
+static CQ_S msg_queues[PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT] = { 0 };
+#if !CQ_CFG_MIRRORED_BUFFER
+static uint8_t msg_queue_bufs[PS_MSG_QUEUES_COUNT][PS_PRIORITY_BUFS_SIZE] = { 0, }; //buffers of the producer queues of all classes
+#endif
+#if PS_ISR_MSG_QUEUE_BUF_SIZE
+#if !CQ_CFG_LOCK_FREE_SPSC
+#error "PS_ISR_MSG_QUEUE_BUF_SIZE requires CQ_CFG_LOCK_FREE_SPSC"
+#endif
+#define PS_DISPATCH_QUEUES_COUNT	(PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT + 1) //ISR queue goes after the message queues, it's dispatched with the highest class
+static CQ_S msg_isr_queue = { 0 };
+#if !CQ_CFG_MIRRORED_BUFFER
+static uint8_t msg_isr_queue_buf[PS_ISR_MSG_QUEUE_BUF_SIZE] = { 0, };
+#endif
+#else
+#define PS_DISPATCH_QUEUES_COUNT	(PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT)
+#endif
+#if CQ_CFG_LOCK_FREE_SPSC
+typedef std::atomic<uint8_t> PsQueueFlag_t; //set by the producer (thread or ISR) and cleared by ps_loop() concurrently
+#define PS_IDLE_FENCE()			std::atomic_thread_fence(std::memory_order_seq_cst)
+#else
+typedef uint8_t PsQueueFlag_t;
+#define PS_IDLE_FENCE()
+#endif
+static PsQueueFlag_t QueueAboveHighFlags[PS_DISPATCH_QUEUES_COUNT]; //1 - high watermark of the queue is reported, low one isn't yet
+static PsQueueFlag_t xPendingLevels; //bit per priority class which queues may have messages, set by the publisher and cleared by ps_loop()
+static queue_watermark_f queue_watermark = NULL;
+static uint8_t u8HighWatermarkPercent = 0;
+static uint8_t u8LowWatermarkPercent = 0;
+static CQ_S * pxDispatchingQueue = NULL; //queue which front is walked by ps_loop(), its messages can't be dropped
+static PsQueueFlag_t xIdleState; //PS_IDLE_AWAKE, PS_IDLE_SLEEPING or PS_IDLE_CANCELLED
+static enter_sleep_f enter_sleep = NULL;
+static on_wakeup_f on_wakeup = NULL;
+static cancel_sleep_f cancel_sleep = NULL;
 static restart_timer_f restart_timer;
 static get_timer_tick_ms_f get_timer_tick_ms;
+static get_time_us_f get_time_us = NULL;
 static PsTopicHash_t xTopic_tpc_cnhg;
 static uint8_t u8Topic_tpc_cnhg_present_flag = 0;
+static PS_THREAD_LOCAL PsPubReservationStruct_s xPubReservation = { 0, };
+static uint16_t u16LevelStreak[PS_PRIORITY_LEVELS_COUNT] = { 0, }; //messages of the priority class dispatched since the last turn of lower classes
+static PS_THREAD_LOCAL uint8_t u8InlineDepth = 0; //nesting of inline deliveries (subscriber publishing into another inline topic)
 
 //returns -1 if failed, 0 - if ok.
 PsResultType_e ps_init(restart_timer_f pxRestart_timer, get_timer_tick_ms_f pxGet_timer_tick_ms) {
-	cq_init(&msg_queue, (char*)msg_queue_buf, sizeof(msg_queue_buf));
+#if CQ_CFG_MIRRORED_BUFFER
+	//hosted build: queue buffers are mapped twice in virtual memory, so messages never wrap
+	for (uint8_t i = 0; i < PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT; i++) {
+		cq_deinitMirrored(&msg_queues[i]);
+		if (!cq_initMirrored(&msg_queues[i], PS_PRIORITY_QUEUE_BUF_SIZE(i % PS_PRIORITY_LEVELS_COUNT))) return PS_RESULT_OUT_OF_MEM;
+	}
+#if PS_ISR_MSG_QUEUE_BUF_SIZE
+	cq_deinitMirrored(&msg_isr_queue);
+	if (!cq_initMirrored(&msg_isr_queue, PS_ISR_MSG_QUEUE_BUF_SIZE)) return PS_RESULT_OUT_OF_MEM;
+#endif
+#else
+	for (uint8_t i = 0; i < PS_MSG_QUEUES_COUNT; i++) {
+		size_t xBufOffset = 0;
+		for (uint8_t u8Level = 0; u8Level < PS_PRIORITY_LEVELS_COUNT; u8Level++) {
+			cq_init(&msg_queues[i * PS_PRIORITY_LEVELS_COUNT + u8Level], (char*)&msg_queue_bufs[i][xBufOffset], PS_PRIORITY_QUEUE_BUF_SIZE(u8Level));
+			xBufOffset += PS_PRIORITY_QUEUE_BUF_SIZE(u8Level);
+		}
+	}
+#if PS_ISR_MSG_QUEUE_BUF_SIZE
+	cq_init(&msg_isr_queue, (char*)msg_isr_queue_buf, sizeof(msg_isr_queue_buf));
+#endif
+#endif
+	xPendingLevels = 0;
 	memset(TopicsArray,0,sizeof(TopicsArray));
+	memset(TopicsColdArray, 0, sizeof(TopicsColdArray));
+	for (xTopicsFreeCount = 0; xTopicsFreeCount < PS_MAX_TOPICS_COUNT; xTopicsFreeCount++) {
+		//lowest slots are used first
+		TopicsFreeList[xTopicsFreeCount] = PS_MAX_TOPICS_COUNT - 1 - xTopicsFreeCount;
+	}
+	//payload pool is one free block
+	memset(PayloadPool, 0, sizeof(PayloadPool));
+	PayloadPool[0].xHdr.u16Words = PS_POOL_WORDS;
+#if PS_LOAN_BLOCKS_COUNT
+	memset(LoanRefsArray, 0, sizeof(LoanRefsArray));
+	for (xLoanFreeCount = 0; xLoanFreeCount < PS_LOAN_BLOCKS_COUNT; xLoanFreeCount++) {
+		LoanFreeList[xLoanFreeCount] = PS_LOAN_BLOCKS_COUNT - 1 - xLoanFreeCount;
+	}
+#endif
+	//topics tree consists of the root node only
+	memset(TopicNodesArray, 0, sizeof(TopicNodesArray));
+	memset(TopicNodesIndex, 0xFF, sizeof(TopicNodesIndex));
+	TopicNodesArray[PS_TOPIC_NODE_ROOT].xParent = PS_TOPIC_NODE_NONE;
+	TopicNodesArray[PS_TOPIC_NODE_ROOT].xFirstChild = PS_TOPIC_NODE_NONE;
+	TopicNodesArray[PS_TOPIC_NODE_ROOT].xNextSibling = PS_TOPIC_NODE_NONE;
+	TopicNodesArray[PS_TOPIC_NODE_ROOT].xTopicHash = PS_TOPIC_NONE;
+	xTopicSegmentsPoolUsed = 0;
+	for (xTopicNodesFreeCount = 0; xTopicNodesFreeCount < PS_MAX_TOPIC_NODES_COUNT - 1; xTopicNodesFreeCount++) {
+		TopicNodesFreeList[xTopicNodesFreeCount] = PS_MAX_TOPIC_NODES_COUNT - 1 - xTopicNodesFreeCount;
+	}
+	memset(WildcardSubsArray, 0, sizeof(WildcardSubsArray));
+	memset(ActorsIndex, 0xFF, sizeof(ActorsIndex));
+	xActorsCount = 0;
+	for (xTimersFreeCount = 0; xTimersFreeCount < PS_MAX_TIMERS_COUNT; xTimersFreeCount++) {
+		TimersFreeList[xTimersFreeCount] = PS_MAX_TIMERS_COUNT - 1 - xTimersFreeCount;
+	}
+	memset(TimerSlotsArray, 0xFF, sizeof(TimerSlotsArray));
+	memset(TimerPendingSlots, 0, sizeof(TimerPendingSlots));
+	u64TimerWheelNow_ms = 0;
+	lTimerTickConsumed_ms = 0;
+	lTimerDeadline_ms = -1;
+#if PS_PRODUCER_QUEUES_COUNT
+	//queues were reinitialized, threads claim them again on next publishing
+	xProducerQueuesClaimed.store(0);
+	xProducerQueuesEpoch.fetch_add(1);
+#endif
 	restart_timer = pxRestart_timer;
 	get_timer_tick_ms = pxGet_timer_tick_ms;
 	return PS_RESULT_OK; //TODO
 }
 
+//FNV-1a hash of the path segment combined with its parent node.
+uint32_t ps_hash_topic_segment(PsNodeId_t xParent, const char * pu8SegmentStr, size_t xSegmentLen) {
+	uint32_t u32Hash = 2166136261u;
+	u32Hash = (u32Hash ^ (uint8_t)xParent) * 16777619u;
+	u32Hash = (u32Hash ^ (uint8_t)(xParent >> 8)) * 16777619u;
+	for (size_t i = 0; i < xSegmentLen; i++) {
+		u32Hash = (u32Hash ^ (uint8_t)pu8SegmentStr[i]) * 16777619u;
+	}
+	return u32Hash;
+}
+
+//returns segment chars of the node (not zero terminated).
+const char * ps_topic_node_segment(PsNodeId_t xNode) {
+	return &TopicSegmentsPool[TopicNodesArray[xNode].xSegmentOffset];
+}
+
+uint32_t ps_hash_topic_node(PsNodeId_t xNode) {
+	return ps_hash_topic_segment(TopicNodesArray[xNode].xParent, ps_topic_node_segment(xNode), TopicNodesArray[xNode].u8SegmentLen);
+}
+
+//returns child of xParent node that holds the segment, PS_TOPIC_NODE_NONE if there is no such child.
+PsNodeId_t ps_find_topic_node(PsNodeId_t xParent, const char * pu8SegmentStr, size_t xSegmentLen) {
+	uint32_t u32Pos = ps_hash_topic_segment(xParent, pu8SegmentStr, xSegmentLen);
+	for (uint32_t i = 0; i < PS_TOPIC_NODES_INDEX_SIZE; i++, u32Pos++) {
+		PsNodeId_t xNode = TopicNodesIndex[u32Pos & (PS_TOPIC_NODES_INDEX_SIZE - 1)];
+		if (PS_TOPIC_NODE_NONE == xNode) break;
+		PsTopicNodeStruct_s * pxNode = &TopicNodesArray[xNode];
+		if ((xParent == pxNode->xParent) && (xSegmentLen == pxNode->u8SegmentLen) && (0 == memcmp(ps_topic_node_segment(xNode), pu8SegmentStr, xSegmentLen))) {
+			return xNode;
+		}
+	}
+	return PS_TOPIC_NODE_NONE;
+}
+
+//creates child of xParent node that holds the segment, returns PS_TOPIC_NODE_NONE if there are no free nodes or no room in the segments pool.
+PsNodeId_t ps_add_topic_node(PsNodeId_t xParent, const char * pu8SegmentStr, size_t xSegmentLen) {
+	if ((0 == xTopicNodesFreeCount) || (xSegmentLen > (size_t)(PS_TOPIC_SEGMENTS_POOL_SIZE - xTopicSegmentsPoolUsed))) return PS_TOPIC_NODE_NONE;
+	PsNodeId_t xNode = TopicNodesFreeList[--xTopicNodesFreeCount];
+	PsTopicNodeStruct_s * pxNode = &TopicNodesArray[xNode];
+	pxNode->xSegmentOffset = xTopicSegmentsPoolUsed;
+	pxNode->u8SegmentLen = (uint8_t)xSegmentLen;
+	memcpy(&TopicSegmentsPool[xTopicSegmentsPoolUsed], pu8SegmentStr, xSegmentLen);
+	xTopicSegmentsPoolUsed += (PsSegmentOffset_t)xSegmentLen;
+	pxNode->xParent = xParent;
+	pxNode->xFirstChild = PS_TOPIC_NODE_NONE;
+	pxNode->xTopicHash = PS_TOPIC_NONE;
+	pxNode->xNextSibling = TopicNodesArray[xParent].xFirstChild;
+	TopicNodesArray[xParent].xFirstChild = xNode;
+	uint32_t u32Pos = ps_hash_topic_segment(xParent, pu8SegmentStr, xSegmentLen);
+	while (PS_TOPIC_NODE_NONE != TopicNodesIndex[u32Pos & (PS_TOPIC_NODES_INDEX_SIZE - 1)]) u32Pos++;
+	TopicNodesIndex[u32Pos & (PS_TOPIC_NODES_INDEX_SIZE - 1)] = xNode;
+	return xNode;
+}
+
+//removes node from the hash index.
+void ps_unindex_topic_node(PsNodeId_t xNode) {
+	uint32_t u32Hole = ps_hash_topic_node(xNode) & (PS_TOPIC_NODES_INDEX_SIZE - 1);
+	while (xNode != TopicNodesIndex[u32Hole]) u32Hole = (u32Hole + 1) & (PS_TOPIC_NODES_INDEX_SIZE - 1);
+	//shift following entries of the probe chain back into the hole, so no tombstones are needed
+	for (uint32_t u32Pos = (u32Hole + 1) & (PS_TOPIC_NODES_INDEX_SIZE - 1); PS_TOPIC_NODE_NONE != TopicNodesIndex[u32Pos]; u32Pos = (u32Pos + 1) & (PS_TOPIC_NODES_INDEX_SIZE - 1)) {
+		uint32_t u32Home = ps_hash_topic_node(TopicNodesIndex[u32Pos]) & (PS_TOPIC_NODES_INDEX_SIZE - 1);
+		//entry can be moved only if its home position is not between the hole and its current position
+		if (((u32Pos - u32Home) & (PS_TOPIC_NODES_INDEX_SIZE - 1)) >= ((u32Pos - u32Hole) & (PS_TOPIC_NODES_INDEX_SIZE - 1))) {
+			TopicNodesIndex[u32Hole] = TopicNodesIndex[u32Pos];
+			u32Hole = u32Pos;
+		}
+	}
+	TopicNodesIndex[u32Hole] = PS_TOPIC_NODE_NONE;
+}
+
+//returns segment chars of the node to the pool, segments stored after them are moved down, so the pool has no holes.
+void ps_free_topic_segment(PsNodeId_t xNode) {
+	PsSegmentOffset_t xOffset = TopicNodesArray[xNode].xSegmentOffset;
+	uint8_t u8Len = TopicNodesArray[xNode].u8SegmentLen;
+	TopicNodesArray[xNode].xSegmentOffset = 0;
+	TopicNodesArray[xNode].u8SegmentLen = 0;
+	if (0 == u8Len) return;
+	memmove(&TopicSegmentsPool[xOffset], &TopicSegmentsPool[xOffset + u8Len], xTopicSegmentsPoolUsed - xOffset - u8Len);
+	xTopicSegmentsPoolUsed -= u8Len;
+	//free nodes have zero offset, so only segments of used nodes are shifted
+	for (uint32_t i = 0; i < PS_MAX_TOPIC_NODES_COUNT; i++) {
+		if (TopicNodesArray[i].xSegmentOffset > xOffset) TopicNodesArray[i].xSegmentOffset -= u8Len;
+	}
+}
+
+//frees unused nodes (without topic and children) going from the node up to the root.
+void ps_prune_topic_nodes(PsNodeId_t xNode) {
+	while ((PS_TOPIC_NODE_ROOT != xNode) && (PS_TOPIC_NODE_NONE == TopicNodesArray[xNode].xFirstChild) && (PS_TOPIC_NONE == TopicNodesArray[xNode].xTopicHash)) {
+		PsNodeId_t xParent = TopicNodesArray[xNode].xParent;
+		//unlink the node from the list of parent's children
+		PsNodeId_t * pxLink = &TopicNodesArray[xParent].xFirstChild;
+		while (xNode != *pxLink) pxLink = &TopicNodesArray[*pxLink].xNextSibling;
+		*pxLink = TopicNodesArray[xNode].xNextSibling;
+		ps_unindex_topic_node(xNode);
+		ps_free_topic_segment(xNode);
+		TopicNodesFreeList[xTopicNodesFreeCount++] = xNode;
+		xNode = xParent;
+	}
+}
+
+//finds (and creates missing nodes if u8CreateFlag is set) the node of the topics tree where the path ends.
+PsResultType_e ps_walk_topic_path(const char * pu8TopicPathStr, uint8_t u8CreateFlag, PsNodeId_t * pxNode) {
+	PsNodeId_t xNode = PS_TOPIC_NODE_ROOT;
+	const char * pu8SegmentStr = pu8TopicPathStr;
+	if (strlen(pu8TopicPathStr) >= PS_MAX_TOPIC_PATH_STR_LENGTH) return PS_RESULT_ERROR;
+	while (1) {
+		const char * pu8SegmentEnd = strchr(pu8SegmentStr, '.');
+		if (NULL == pu8SegmentEnd) pu8SegmentEnd = pu8SegmentStr + strlen(pu8SegmentStr);
+		size_t xSegmentLen = (size_t)(pu8SegmentEnd - pu8SegmentStr);
+		PsNodeId_t xChild = ps_find_topic_node(xNode, pu8SegmentStr, xSegmentLen);
+		if ((PS_TOPIC_NODE_NONE == xChild) && u8CreateFlag) {
+			xChild = ps_add_topic_node(xNode, pu8SegmentStr, xSegmentLen);
+		}
+		if (PS_TOPIC_NODE_NONE == xChild) {
+			if (u8CreateFlag) ps_prune_topic_nodes(xNode); //remove nodes created for the failed path
+			return u8CreateFlag ? PS_RESULT_OUT_OF_MEM : PS_RESULT_NOT_FOUND; //topics tree is full or the path isn't there
+		}
+		xNode = xChild;
+		if ('\0' == *pu8SegmentEnd) break;
+		pu8SegmentStr = pu8SegmentEnd + 1;
+	}
+	*pxNode = xNode;
+	return PS_RESULT_OK;
+}
+
+//writes full path of the topics tree node into the buffer, returns length of the path.
+size_t ps_build_topic_path(PsNodeId_t xNode, char * pu8PathStr, size_t xPathStrSize) {
+	size_t xLen = 0;
+	pu8PathStr[0] = '\0';
+	if (PS_TOPIC_NODE_ROOT == xNode) return 0;
+	//measure the path first, then fill it from the end
+	for (PsNodeId_t n = xNode; PS_TOPIC_NODE_ROOT != n; n = TopicNodesArray[n].xParent) {
+		xLen += TopicNodesArray[n].u8SegmentLen + 1;
+	}
+	xLen--; //no dot before the first segment
+	if (xLen >= xPathStrSize) return 0;
+	size_t xPos = xLen;
+	pu8PathStr[xLen] = '\0';
+	for (PsNodeId_t n = xNode; PS_TOPIC_NODE_ROOT != n; n = TopicNodesArray[n].xParent) {
+		size_t xSegmentLen = TopicNodesArray[n].u8SegmentLen;
+		xPos -= xSegmentLen;
+		memcpy(&pu8PathStr[xPos], ps_topic_node_segment(n), xSegmentLen);
+		if (xPos > 0) pu8PathStr[--xPos] = '.';
+	}
+	return xLen;
+}
+
 void ps_report_topic_change(PsTopicHash_t xTopicHash, const char * prefix) {
 	if (u8Topic_tpc_cnhg_present_flag) {
 		//notify about topic remove
 		char msg_str[PS_MAX_MESSAGE_PAYLOAD_LENGTH];
-		int length = snprintf(msg_str, sizeof(msg_str), "%s %u %s[%u]", prefix, xTopicHash, TopicsArray[xTopicHash].pu8TopicPathStr, TopicsArray[xTopicHash].xDtype);
+		char path_str[PS_MAX_TOPIC_PATH_STR_LENGTH];
+		(void)ps_build_topic_path(TopicsArray[xTopicHash].xNode, path_str, sizeof(path_str));
+		int length = snprintf(msg_str, sizeof(msg_str), "%s %u %s[%u]", prefix, xTopicHash, path_str, TopicsArray[xTopicHash].xDtype);
 		ps_pub_topic(NULL, xTopic_tpc_cnhg, length, msg_str);
 	}
 }
 
+//returns end of the path segment (dot or terminating zero).
+const char * ps_segment_end(const char * pu8SegmentStr) {
+	const char * pu8SegmentEnd = strchr(pu8SegmentStr, '.');
+	return (NULL != pu8SegmentEnd) ? pu8SegmentEnd : pu8SegmentStr + strlen(pu8SegmentStr);
+}
+
+//returns the first wildcard segment ("*" or "#") of the path, NULL if the path is exact.
+const char * ps_find_wildcard_segment(const char * pu8TopicPathStr) {
+	for (const char * pu8SegmentStr = pu8TopicPathStr; ; pu8SegmentStr++) {
+		if ((('*' == pu8SegmentStr[0]) || ('#' == pu8SegmentStr[0])) && (ps_segment_end(pu8SegmentStr) == pu8SegmentStr + 1)) {
+			return pu8SegmentStr;
+		}
+		pu8SegmentStr = strchr(pu8SegmentStr, '.');
+		if (NULL == pu8SegmentStr) return NULL;
+	}
+}
+
+//checks the topic path against the pattern: "*" matches exactly one segment, trailing "#" matches the rest of the path (possibly nothing).
+uint8_t ps_match_topic_pattern(const char * pu8TopicPatternStr, const char * pu8TopicPathStr) {
+	while (1) {
+		if (0 == strcmp(pu8TopicPatternStr, "#")) return 1;
+		const char * pu8PatternEnd = ps_segment_end(pu8TopicPatternStr);
+		const char * pu8PathEnd = ps_segment_end(pu8TopicPathStr);
+		if (('*' != pu8TopicPatternStr[0]) || (pu8PatternEnd != pu8TopicPatternStr + 1)) {
+			size_t xSegmentLen = (size_t)(pu8PatternEnd - pu8TopicPatternStr);
+			if ((xSegmentLen != (size_t)(pu8PathEnd - pu8TopicPathStr)) || (0 != memcmp(pu8TopicPatternStr, pu8TopicPathStr, xSegmentLen))) return 0;
+		}
+		if ('\0' == *pu8PatternEnd) return '\0' == *pu8PathEnd;
+		if ('\0' == *pu8PathEnd) return 0 == strcmp(pu8PatternEnd + 1, "#");
+		pu8TopicPatternStr = pu8PatternEnd + 1;
+		pu8TopicPathStr = pu8PathEnd + 1;
+	}
+}
+
+uint8_t ps_is_topic_used(PsTopicHash_t xTopicHash) {
+	return (xTopicHash < PS_MAX_TOPICS_COUNT) && (PS_TOPIC_NODE_ROOT != TopicsArray[xTopicHash].xNode);
+}
+
 PsResultType_e ps_find_topic(const char * pu8TopicPathStr, PsTopicHash_t * pxTopicHash) {
-	for (PsTopicHash_t i = 0; i < PS_MAX_TOPICS_COUNT; i++) {
-		if (NULL != pu8TopicPathStr) {
-			if ('\0' == TopicsArray[i].pu8TopicPathStr[0]) continue;
-			if (0 == strncmp(TopicsArray[i].pu8TopicPathStr, pu8TopicPathStr, sizeof(TopicsArray[i].pu8TopicPathStr))) {
-				//found existing topic
-				*pxTopicHash = i;
-				return PS_RESULT_OK;
+	PsNodeId_t xNode;
+	if (NULL == pu8TopicPathStr) {
+		if (0 == xTopicsFreeCount) return PS_RESULT_NOT_FOUND;
+		//found empty topic slot
+		*pxTopicHash = TopicsFreeList[xTopicsFreeCount - 1];
+		return PS_RESULT_OK;
+	}
+	PsResultType_e result = ps_walk_topic_path(pu8TopicPathStr, 0, &xNode);
+	if (PS_RESULT_OK != result) return result;
+	if (PS_TOPIC_NONE == TopicNodesArray[xNode].xTopicHash) return PS_RESULT_NOT_FOUND; //path exists only as a prefix of other topics
+	//found existing topic
+	*pxTopicHash = TopicNodesArray[xNode].xTopicHash;
+	return PS_RESULT_OK;
+}
+
+//takes the first free block of the payload pool that fits xSize bytes, returns PS_POOL_BLOCK_NONE if there is no such block.
+//The caller holds the pool lock.
+PsPoolBlock_t ps_pool_take(PsMsgLen_t xSize) {
+	uint32_t u32Words = 1 + (xSize + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	uint32_t u32Block = 0;
+	while (u32Block < PS_POOL_WORDS) {
+		PsPoolBlockHdrStruct_s * pxHdr = &PayloadPool[u32Block].xHdr;
+		if (0 == pxHdr->u8Used) {
+			//merge free neighbours, so blocks of released long messages can be reused by longer ones
+			while ((u32Block + pxHdr->u16Words < PS_POOL_WORDS) && (0 == PayloadPool[u32Block + pxHdr->u16Words].xHdr.u8Used)) {
+				pxHdr->u16Words += PayloadPool[u32Block + pxHdr->u16Words].xHdr.u16Words;
 			}
-		} else {
-			if ('\0' == TopicsArray[i].pu8TopicPathStr[0]) {
-				//found empty topic slot
-				*pxTopicHash = i;
-				return PS_RESULT_OK;
+			if (pxHdr->u16Words >= u32Words) {
+				if (pxHdr->u16Words > u32Words) {
+					//split the rest into a free block
+					PayloadPool[u32Block + u32Words].xHdr.u16Words = (uint16_t)(pxHdr->u16Words - u32Words);
+					PayloadPool[u32Block + u32Words].xHdr.u8Used = 0;
+				}
+				pxHdr->u16Words = (uint16_t)u32Words;
+				pxHdr->u8Used = 1;
+				pxHdr->xMsgLen = 0;
+				return (PsPoolBlock_t)u32Block;
 			}
 		}
+		u32Block += pxHdr->u16Words;
+	}
+	return PS_POOL_BLOCK_NONE;
+}
+
+PsPoolBlock_t ps_pool_alloc(PsMsgLen_t xSize) {
+	PS_POOL_LOCK();
+	PsPoolBlock_t xBlock = ps_pool_take(xSize);
+	PS_POOL_UNLOCK();
+	return xBlock;
+}
 
+void ps_pool_free(PsPoolBlock_t xBlock) {
+	PS_POOL_LOCK();
+	PayloadPool[xBlock].xHdr.u8Used = 0;
+	PS_POOL_UNLOCK();
+}
+
+void * ps_pool_payload(PsPoolBlock_t xBlock) {
+	return &PayloadPool[xBlock + 1];
+}
+
+//returns max payload length the block can hold.
+PsMsgLen_t ps_pool_capacity(PsPoolBlock_t xBlock) {
+	uint32_t u32Capacity = (PayloadPool[xBlock].xHdr.u16Words - 1) * sizeof(uint64_t);
+	return (u32Capacity > UINT16_MAX) ? UINT16_MAX : (PsMsgLen_t)u32Capacity;
+}
+
+//returns 1 if the longest message of the topic capacity can be published: inline, through the payload pool or as a loaned buffer.
+uint8_t ps_is_capacity_served(PsMsgLen_t xMaxMsgLen) {
+#if PS_LOAN_BLOCKS_COUNT
+	if (xMaxMsgLen <= PS_LOAN_BLOCK_SIZE) return 1;
+#endif
+	return (uint8_t)((xMaxMsgLen <= PS_MAX_MESSAGE_PAYLOAD_LENGTH) || (xMaxMsgLen <= PS_POOL_MAX_PAYLOAD));
+}
+
+//creates empty topic in a free slot and attaches it to the topics tree.
+PsResultType_e ps_create_topic(const char * pu8TopicPathStr, PsTopicHash_t * pxTopicHash) {
+	PsTopicHash_t xTopicHash;
+	PsNodeId_t xNode;
+	if (NULL != ps_find_wildcard_segment(pu8TopicPathStr)) return PS_RESULT_ERROR; //patterns are not topics
+	PsResultType_e result = ps_find_topic(NULL, &xTopicHash);
+	if (PS_RESULT_OK != result) return result;
+	result = ps_walk_topic_path(pu8TopicPathStr, 1, &xNode);
+	if (PS_RESULT_OK != result) return result;
+	xTopicsFreeCount--; //the slot is on the top of the free list
+	memset(&TopicsArray[xTopicHash], 0, sizeof(TopicsArray[xTopicHash]));
+	memset(&TopicsColdArray[xTopicHash], 0, sizeof(TopicsColdArray[xTopicHash]));
+	TopicsArray[xTopicHash].xNode = xNode;
+	TopicsArray[xTopicHash].xMaxMsgLen = PS_MAX_MESSAGE_PAYLOAD_LENGTH;
+	TopicsColdArray[xTopicHash].xPendingBlock = PS_POOL_BLOCK_NONE;
+	TopicsColdArray[xTopicHash].xTimer = PS_TIMER_NONE;
+	TopicNodesArray[xNode].xTopicHash = xTopicHash;
+	*pxTopicHash = xTopicHash;
+	return PS_RESULT_OK;
+}
+
+//detaches topic from the topics tree and frees its slot.
+void ps_remove_topic(PsTopicHash_t xTopicHash) {
+	PsNodeId_t xNode = TopicsArray[xTopicHash].xNode;
+	TopicNodesArray[xNode].xTopicHash = PS_TOPIC_NONE;
+	ps_prune_topic_nodes(xNode);
+	if (TopicsArray[xTopicHash].u8Sticky_flag) {
+		ps_pool_free(TopicsColdArray[xTopicHash].xStickyBlock);
 	}
-	//neither topic nor space for it found
-	return PS_RESULT_NOT_FOUND;
+	if (PS_TIMER_NONE != TopicsColdArray[xTopicHash].xTimer) {
+		ps_timer_free(TopicsColdArray[xTopicHash].xTimer);
+	}
+	memset(&TopicsArray[xTopicHash], 0, sizeof(TopicsArray[xTopicHash]));
+	memset(&TopicsColdArray[xTopicHash], 0, sizeof(TopicsColdArray[xTopicHash]));
+	TopicsFreeList[xTopicsFreeCount++] = xTopicHash;
+}
+
+//makes the topic "sticky" taking a block of the payload pool (of the topic capacity) for its last value.
+PsResultType_e ps_make_topic_sticky(PsTopicHash_t xTopicHash) {
+	if (TopicsArray[xTopicHash].u8Sticky_flag) return PS_RESULT_OK;
+	PsPoolBlock_t xBlock = ps_pool_alloc(TopicsArray[xTopicHash].xMaxMsgLen);
+	if (PS_POOL_BLOCK_NONE == xBlock) return PS_RESULT_OUT_OF_MEM;
+	memset(ps_pool_payload(xBlock), 0, ps_pool_capacity(xBlock));
+	TopicsColdArray[xTopicHash].xStickyBlock = xBlock;
+	TopicsArray[xTopicHash].u8Sticky_flag = 1;
+	return PS_RESULT_OK;
 }
 
-uint8_t ps_is_all_zero(void * mem, size_t length) {
-	uint8_t allZero = 1;
-	uint8_t * array = (uint8_t *)mem;
-	for (size_t i = 0; i < length; i++) {
-		if(array[i]) {
-			return 0;
+//sets payload capacity of the topic, storage of the "sticky" value follows it.
+PsResultType_e ps_set_topic_capacity(PsTopicHash_t xTopicHash, PsMsgLen_t xMaxMsgLen) {
+	PsTopicStruct_s * pxTopic = &TopicsArray[xTopicHash];
+	if (xMaxMsgLen == pxTopic->xMaxMsgLen) return PS_RESULT_OK;
+	if (pxTopic->u8Sticky_flag) {
+		PsPoolBlock_t xBlock = ps_pool_alloc(xMaxMsgLen);
+		if (PS_POOL_BLOCK_NONE == xBlock) return PS_RESULT_OUT_OF_MEM;
+		memset(ps_pool_payload(xBlock), 0, ps_pool_capacity(xBlock));
+		ps_pool_free(TopicsColdArray[xTopicHash].xStickyBlock);
+		TopicsColdArray[xTopicHash].xStickyBlock = xBlock;
+	}
+	pxTopic->xMaxMsgLen = xMaxMsgLen;
+	return PS_RESULT_OK;
+}
+
+PsPoolBlockHdrStruct_s * ps_sticky_value(PsTopicHash_t xTopicHash) {
+	return &PayloadPool[TopicsColdArray[xTopicHash].xStickyBlock].xHdr;
+}
+
+void * ps_sticky_payload(PsTopicHash_t xTopicHash) {
+	return ps_pool_payload(TopicsColdArray[xTopicHash].xStickyBlock);
+}
+
+PsResultType_e ps_for_each_topic(const char * pu8TopicPathStr, topic_visitor_f pxVisitor, void * pvContext) {
+	PsNodeId_t xTop = PS_TOPIC_NODE_ROOT;
+	if (NULL != pu8TopicPathStr) {
+		PsResultType_e result = ps_walk_topic_path(pu8TopicPathStr, 0, &xTop);
+		if (PS_RESULT_OK != result) return result;
+	}
+	//pre-order walk through the subtree without recursion
+	PsNodeId_t xNode = xTop;
+	while (PS_TOPIC_NODE_NONE != xNode) {
+		PsTopicHash_t xTopicHash = TopicNodesArray[xNode].xTopicHash;
+		//go down first, then to the next sibling climbing up until the top of the subtree is reached.
+		//The next node is found before the visit: removal of the visited topic prunes only its node and unused nodes above it.
+		PsNodeId_t xNext = TopicNodesArray[xNode].xFirstChild;
+		if (PS_TOPIC_NODE_NONE == xNext) {
+			PsNodeId_t xUp = xNode;
+			while ((xTop != xUp) && (PS_TOPIC_NODE_NONE == TopicNodesArray[xUp].xNextSibling)) {
+				xUp = TopicNodesArray[xUp].xParent;
+			}
+			xNext = (xTop == xUp) ? PS_TOPIC_NODE_NONE : TopicNodesArray[xUp].xNextSibling;
 		}
+		if (PS_TOPIC_NONE != xTopicHash) {
+			pxVisitor(xTopicHash, pvContext);
+		}
+		xNode = xNext;
 	}
-	return 1;
+	return PS_RESULT_OK;
 }
 
-PsResultType_e ps_find_actor(actor_f pxActors[PS_MAX_ACTORS_COUNT], actor_f pxActorHandler, PsActorId_t * pxActorIdx) {
-	for (PsActorId_t i = 0; i < PS_MAX_ACTORS_COUNT; i++) {
-		if (pxActorHandler == pxActors[i]) {
-			//found existing actor
-			*pxActorIdx = i;
+//returns natural alignment of the data type, payloads are passed to actors directly from the queue buffer only if they are aligned.
+size_t ps_dtype_alignment(PsDataType_e xDataType) {
+	switch (xDataType) {
+	case PS_DTYPE_U16:
+	case PS_DTYPE_I16:
+		return sizeof(uint16_t);
+	case PS_DTYPE_U32:
+	case PS_DTYPE_I32:
+		return sizeof(uint32_t);
+	case PS_DTYPE_U64:
+	case PS_DTYPE_I64:
+	case PS_DTYPE_TIMESTAMP:
+		return sizeof(uint64_t);
+	default:
+		return 1;
+	}
+}
+
+uint32_t ps_hash_actor(actor_f pxActorHandler) {
+	uint32_t u32Hash = (uint32_t)((uintptr_t)pxActorHandler >> 2) * 2654435761u;
+	return u32Hash ^ (u32Hash >> 16);
+}
+
+//returns id of the registered actor, PS_ACTOR_NONE if the actor is unknown.
+PsActorId_t ps_find_actor(actor_f pxActorHandler) {
+	uint32_t u32Pos = ps_hash_actor(pxActorHandler);
+	for (uint16_t i = 0; i < PS_ACTORS_INDEX_SIZE; i++, u32Pos++) {
+		PsActorId_t xActorId = ActorsIndex[u32Pos & (PS_ACTORS_INDEX_SIZE - 1)];
+		if (PS_ACTOR_NONE == xActorId) break;
+		if (pxActorHandler == ActorsArray[xActorId]) return xActorId;
+	}
+	return PS_ACTOR_NONE;
+}
+
+//returns id of the actor registering it on the first use, PS_ACTOR_NONE if there is no space for a new actor.
+PsActorId_t ps_register_actor(actor_f pxActorHandler) {
+	PsActorId_t xActorId = ps_find_actor(pxActorHandler);
+	if ((PS_ACTOR_NONE != xActorId) || (PS_MAX_ACTORS_COUNT == xActorsCount)) return xActorId;
+	xActorId = xActorsCount++;
+	ActorsArray[xActorId] = pxActorHandler;
+	uint32_t u32Pos = ps_hash_actor(pxActorHandler);
+	while (PS_ACTOR_NONE != ActorsIndex[u32Pos & (PS_ACTORS_INDEX_SIZE - 1)]) u32Pos++;
+	ActorsIndex[u32Pos & (PS_ACTORS_INDEX_SIZE - 1)] = xActorId;
+	return xActorId;
+}
+
+//returns bit of the actor in actor sets, 0 if the actor is unknown.
+PsActorSet_t ps_actor_bit(actor_f pxActorHandler) {
+	PsActorId_t xActorId = ps_find_actor(pxActorHandler);
+	return (PS_ACTOR_NONE == xActorId) ? 0 : PS_ACTOR_BIT(xActorId);
+}
+
+//returns index of the lowest set bit, xSet must not be 0.
+PsActorId_t ps_lowest_actor(PsActorSet_t xSet) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (PsActorId_t)__builtin_ctz(xSet);
+#elif defined(_MSC_VER)
+	unsigned long u32Idx;
+	_BitScanForward(&u32Idx, xSet);
+	return (PsActorId_t)u32Idx;
+#else
+	PsActorId_t xActorId = 0;
+	while (0 == (xSet & 1)) {
+		xSet >>= 1;
+		xActorId++;
+	}
+	return xActorId;
+#endif
+}
+
+//adds publisher to the topic, returns PS_RESULT_DUPLICATED if it's already there.
+PsResultType_e ps_add_topic_publisher(PsTopicHash_t xTopicHash, actor_f pxActorHandler) {
+	PsActorId_t xActorId = ps_register_actor(pxActorHandler);
+	if (PS_ACTOR_NONE == xActorId) return PS_RESULT_ERROR;
+	if (TopicsArray[xTopicHash].xPublishers & PS_ACTOR_BIT(xActorId)) return PS_RESULT_DUPLICATED;
+	TopicsArray[xTopicHash].xPublishers |= PS_ACTOR_BIT(xActorId);
+	return PS_RESULT_OK;
+}
+
+PsActorSet_t * ps_topic_subscribers_set(PsTopicHash_t xTopicHash, uint8_t u8SubFlag) {
+	return (PS_SUB_FLAG_EXPLICIT == u8SubFlag) ? &TopicsColdArray[xTopicHash].xExplicitSubscribers : &TopicsColdArray[xTopicHash].xWildcardSubscribers;
+}
+
+//adds the subscription kind to the topic, subscriber joins the fan-out set with the first one.
+PsResultType_e ps_add_topic_subscriber(PsTopicHash_t xTopicHash, actor_f pxActorHandler, uint8_t u8SubFlag) {
+	if (NULL == pxActorHandler) return PS_RESULT_ERROR;
+	PsActorId_t xActorId = ps_register_actor(pxActorHandler);
+	if (PS_ACTOR_NONE == xActorId) return PS_RESULT_ERROR;
+	*ps_topic_subscribers_set(xTopicHash, u8SubFlag) |= PS_ACTOR_BIT(xActorId);
+	TopicsArray[xTopicHash].xSubscribers |= PS_ACTOR_BIT(xActorId);
+	return PS_RESULT_OK;
+}
+
+//removes the subscription kind from the topic, subscriber leaves the fan-out set with the last one.
+PsResultType_e ps_remove_topic_subscriber(PsTopicHash_t xTopicHash, actor_f pxActorHandler, uint8_t u8SubFlag) {
+	PsActorSet_t xActorBit = ps_actor_bit(pxActorHandler);
+	PsActorSet_t * pxSet = ps_topic_subscribers_set(xTopicHash, u8SubFlag);
+	if (0 == (*pxSet & xActorBit)) return PS_RESULT_ERROR;
+	*pxSet &= ~xActorBit;
+	TopicsArray[xTopicHash].xSubscribers = TopicsColdArray[xTopicHash].xExplicitSubscribers | TopicsColdArray[xTopicHash].xWildcardSubscribers;
+	return PS_RESULT_OK;
+}
+
+//checks if any wildcard subscription of the actor matches the topic path.
+uint8_t ps_match_wildcard_subs(const char * pu8TopicPathStr, actor_f pxActorHandler) {
+	for (uint8_t i = 0; i < PS_MAX_WILDCARD_SUBS_COUNT; i++) {
+		if ((pxActorHandler == WildcardSubsArray[i].pxActorHandler) && ps_match_topic_pattern(WildcardSubsArray[i].pu8TopicPatternStr, pu8TopicPathStr)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//adds subscribers of matching wildcards to the new topic.
+void ps_apply_wildcard_subs(PsTopicHash_t xTopicHash) {
+	char path_str[PS_MAX_TOPIC_PATH_STR_LENGTH];
+	(void)ps_build_topic_path(TopicsArray[xTopicHash].xNode, path_str, sizeof(path_str));
+	for (uint8_t i = 0; i < PS_MAX_WILDCARD_SUBS_COUNT; i++) {
+		if ((NULL != WildcardSubsArray[i].pxActorHandler) && ps_match_topic_pattern(WildcardSubsArray[i].pu8TopicPatternStr, path_str)) {
+			//fan-out list is full - the topic is just not delivered to this wildcard subscriber
+			(void)ps_add_topic_subscriber(xTopicHash, WildcardSubsArray[i].pxActorHandler, PS_SUB_FLAG_WILDCARD);
+		}
+	}
+}
+
+void ps_wildcard_sub_visitor(PsTopicHash_t xTopicHash, void * pvContext) {
+	PsWildcardVisitStruct_s * pxVisit = (PsWildcardVisitStruct_s *)pvContext;
+	char path_str[PS_MAX_TOPIC_PATH_STR_LENGTH];
+	(void)ps_build_topic_path(TopicsArray[xTopicHash].xNode, path_str, sizeof(path_str));
+	if (0 == ps_match_topic_pattern(pxVisit->pu8TopicPatternStr, path_str)) return;
+	if (pxVisit->u8SubscribeFlag) {
+		if (PS_RESULT_OK != ps_add_topic_subscriber(xTopicHash, pxVisit->pxActorHandler, PS_SUB_FLAG_WILDCARD)) pxVisit->xResult = PS_RESULT_ERROR;
+	} else if (0 == ps_match_wildcard_subs(path_str, pxVisit->pxActorHandler)) {
+		//the topic isn't matched by other wildcards of the actor anymore
+		(void)ps_remove_topic_subscriber(xTopicHash, pxVisit->pxActorHandler, PS_SUB_FLAG_WILDCARD);
+		(void)ps_manage_topic(xTopicHash);
+	}
+}
+
+//visits existing topics which may match the pattern - the subtree of its exact prefix.
+void ps_visit_wildcard_topics(PsWildcardVisitStruct_s * pxVisit) {
+	char prefix_str[PS_MAX_TOPIC_PATH_STR_LENGTH];
+	size_t xPrefixLen = (size_t)(ps_find_wildcard_segment(pxVisit->pu8TopicPatternStr) - pxVisit->pu8TopicPatternStr);
+	if (0 == xPrefixLen) {
+		(void)ps_for_each_topic(NULL, ps_wildcard_sub_visitor, pxVisit);
+		return;
+	}
+	//skip the dot before the wildcard segment
+	memcpy(prefix_str, pxVisit->pu8TopicPatternStr, xPrefixLen - 1);
+	prefix_str[xPrefixLen - 1] = '\0';
+	(void)ps_for_each_topic(prefix_str, ps_wildcard_sub_visitor, pxVisit);
+}
+
+PsResultType_e ps_unsub_wildcard_topic(const char * pu8TopicPatternStr, actor_f pxActorHandler) {
+	for (uint8_t i = 0; i < PS_MAX_WILDCARD_SUBS_COUNT; i++) {
+		if ((pxActorHandler == WildcardSubsArray[i].pxActorHandler) && (0 == strcmp(pu8TopicPatternStr, WildcardSubsArray[i].pu8TopicPatternStr))) {
+			memset(&WildcardSubsArray[i], 0, sizeof(WildcardSubsArray[i]));
+			PsWildcardVisitStruct_s xVisit = { pu8TopicPatternStr, pxActorHandler, 0, PS_RESULT_OK };
+			ps_visit_wildcard_topics(&xVisit);
 			return PS_RESULT_OK;
 		}
 	}
-	//actor not found
 	return PS_RESULT_NOT_FOUND;
 }
 
-PsResultType_e ps_register_actor(actor_f pxActors[PS_MAX_ACTORS_COUNT], actor_f pxActorHandler, PsActorId_t * pxActorIdx) {
-	PsActorId_t xActorIdx = 0;
-	if (PS_RESULT_OK == ps_find_actor(pxActors, pxActorHandler, &xActorIdx)) {
-		if(NULL != pxActorIdx) *pxActorIdx = xActorIdx;
-		return PS_RESULT_DUPLICATED;
-	} 
-	//actor not found, find and use an empty slot in actor array
-	if (PS_RESULT_OK == ps_find_actor(pxActors, NULL, &xActorIdx)) {
-		if (NULL != pxActorIdx) *pxActorIdx = xActorIdx;
-		pxActors[xActorIdx] = pxActorHandler;
-		return PS_RESULT_OK;
+PsResultType_e ps_sub_wildcard_topic(const char * pu8TopicPatternStr, actor_f pxActorHandler) {
+	if ((NULL == pxActorHandler) || (strlen(pu8TopicPatternStr) >= PS_MAX_TOPIC_PATH_STR_LENGTH)) return PS_RESULT_ERROR;
+	//"#" is allowed only as the last segment
+	for (const char * pu8SegmentStr = pu8TopicPatternStr; ; ) {
+		const char * pu8SegmentEnd = ps_segment_end(pu8SegmentStr);
+		if ('\0' == *pu8SegmentEnd) break;
+		if (('#' == pu8SegmentStr[0]) && (pu8SegmentEnd == pu8SegmentStr + 1)) return PS_RESULT_ERROR;
+		pu8SegmentStr = pu8SegmentEnd + 1;
 	}
-	//no empty slot and no actor found in the array, it's unexpected case and thereby fatal error!
-	return PS_RESULT_ERROR;
+	uint8_t u8FreeIdx = PS_MAX_WILDCARD_SUBS_COUNT;
+	for (uint8_t i = 0; i < PS_MAX_WILDCARD_SUBS_COUNT; i++) {
+		if (NULL == WildcardSubsArray[i].pxActorHandler) {
+			if (PS_MAX_WILDCARD_SUBS_COUNT == u8FreeIdx) u8FreeIdx = i;
+		} else if ((pxActorHandler == WildcardSubsArray[i].pxActorHandler) && (0 == strcmp(pu8TopicPatternStr, WildcardSubsArray[i].pu8TopicPatternStr))) {
+			return PS_RESULT_DUPLICATED;
+		}
+	}
+	if (PS_MAX_WILDCARD_SUBS_COUNT == u8FreeIdx) return PS_RESULT_OUT_OF_MEM;
+	strcpy(WildcardSubsArray[u8FreeIdx].pu8TopicPatternStr, pu8TopicPatternStr);
+	WildcardSubsArray[u8FreeIdx].pxActorHandler = pxActorHandler;
+	//resolve the pattern into fan-out lists of existing topics, new topics get it in ps_apply_wildcard_subs()
+	PsWildcardVisitStruct_s xVisit = { WildcardSubsArray[u8FreeIdx].pu8TopicPatternStr, pxActorHandler, 1, PS_RESULT_OK };
+	ps_visit_wildcard_topics(&xVisit);
+	if (PS_RESULT_OK != xVisit.xResult) {
+		//some fan-out list is full, don't leave the subscription half applied
+		(void)ps_unsub_wildcard_topic(pu8TopicPatternStr, pxActorHandler);
+	}
+	return xVisit.xResult;
 }
 
 PsResultType_e ps_register_topic_publisher(actor_f pxActorHandler, PsDataType_e xDataType, const char * pu8TopicPathStr, const char * pu8TopicInfoStr, uint8_t u8Sticky_flag, PsTopicHash_t * pxTopicHash) {
+	return ps_register_topic_publisher_sized(pxActorHandler, xDataType, pu8TopicPathStr, pu8TopicInfoStr, u8Sticky_flag, PS_MAX_MESSAGE_PAYLOAD_LENGTH, pxTopicHash);
+}
+
+PsResultType_e ps_register_topic_publisher_sized(actor_f pxActorHandler, PsDataType_e xDataType, const char * pu8TopicPathStr, const char * pu8TopicInfoStr, uint8_t u8Sticky_flag, PsMsgLen_t xMaxMsgLen, PsTopicHash_t * pxTopicHash) {
 	PsTopicHash_t xTopicHash = 0;
+	if (0 == ps_is_capacity_served(xMaxMsgLen)) return PS_RESULT_OUT_OF_MEM;
 	if (PS_RESULT_OK == ps_find_topic(pu8TopicPathStr, &xTopicHash)) {
 		*pxTopicHash = xTopicHash;
 		//we already have this topic registered, just add publisher
-		if (0 == ps_is_all_zero(TopicsArray[xTopicHash].pxPublishers, sizeof(TopicsArray[xTopicHash].pxPublishers))) {
-			TopicsArray[xTopicHash].u8Sticky_flag |= u8Sticky_flag;
-			if (xDataType != TopicsArray[xTopicHash].xDtype) {
+		if (0 != TopicsArray[xTopicHash].xPublishers) {
+			if ((xDataType != TopicsArray[xTopicHash].xDtype) || (xMaxMsgLen > TopicsArray[xTopicHash].xMaxMsgLen)) {
 				return PS_RESULT_REDEF_CONFLICT;
 			}
+			if (u8Sticky_flag && (PS_RESULT_OK != ps_make_topic_sticky(xTopicHash))) {
+				return PS_RESULT_OUT_OF_MEM;
+			}
+		} else if (PS_RESULT_OK != ps_set_topic_capacity(xTopicHash, xMaxMsgLen)) {
+			//the first publisher declares capacity of the topic created by its subscribers
+			return PS_RESULT_OUT_OF_MEM;
 		}
-		if (PS_RESULT_ERROR != ps_register_actor(TopicsArray[xTopicHash].pxPublishers, pxActorHandler, NULL)) {
+		if (PS_RESULT_ERROR != ps_add_topic_publisher(xTopicHash, pxActorHandler)) {
 			return PS_RESULT_OK;
 		}
 	} else {
 		//topic not found and has to be created
-		if (PS_RESULT_OK == ps_find_topic(NULL, &xTopicHash)) {
+		PsResultType_e result = ps_create_topic(pu8TopicPathStr, &xTopicHash);
+		if (PS_RESULT_OUT_OF_MEM == result) return result; //topics tree is full
+		if (PS_RESULT_OK == result) {
 			*pxTopicHash = xTopicHash;
-			TopicsArray[xTopicHash].u8Sticky_flag = u8Sticky_flag;
 			TopicsArray[xTopicHash].xDtype = xDataType;
-			//we found empty slot for the topic, just add publisher
-			if (PS_RESULT_ERROR != ps_register_actor(TopicsArray[xTopicHash].pxPublishers, pxActorHandler, NULL)) {
-				strncpy(TopicsArray[xTopicHash].pu8TopicInfoStr, pu8TopicInfoStr, sizeof(TopicsArray[xTopicHash].pu8TopicInfoStr));
-				strncpy(TopicsArray[xTopicHash].pu8TopicPathStr, pu8TopicPathStr, sizeof(TopicsArray[xTopicHash].pu8TopicPathStr));		
+			TopicsArray[xTopicHash].xMaxMsgLen = xMaxMsgLen;
+			//we created the topic, just add publisher
+			if (((0 == u8Sticky_flag) || (PS_RESULT_OK == ps_make_topic_sticky(xTopicHash))) && (PS_RESULT_ERROR != ps_add_topic_publisher(xTopicHash, pxActorHandler))) {
+				strncpy(TopicsColdArray[xTopicHash].pu8TopicInfoStr, pu8TopicInfoStr, sizeof(TopicsColdArray[xTopicHash].pu8TopicInfoStr));
+				ps_apply_wildcard_subs(xTopicHash);
 				ps_report_topic_change(xTopicHash, "ADD");
 				return PS_RESULT_OK;
-			} 			
+			}
+			ps_remove_topic(xTopicHash);
 		}
 	}
 	return PS_RESULT_ERROR;
 }
 
+PsResultType_e ps_register_static_topics(const PsStaticTopicStruct_s * pxTopics, PsTopicHash_t xTopicsCount, const PsStaticActorLinkStruct_s * pxLinks, size_t xLinksCount) {
+	//static topics take the first slots in table order, it's what makes their hashes known at compile time
+	if (PS_MAX_TOPICS_COUNT != xTopicsFreeCount) return PS_RESULT_ERROR;
+	if (xTopicsCount > PS_MAX_TOPICS_COUNT) return PS_RESULT_OUT_OF_MEM;
+	for (PsTopicHash_t i = 0; i < xTopicsCount; i++) {
+		PsTopicHash_t xTopicHash;
+		if (PS_RESULT_NOT_FOUND != ps_find_topic(pxTopics[i].pu8TopicPathStr, &xTopicHash)) return PS_RESULT_DUPLICATED;
+		PsResultType_e result = ps_create_topic(pxTopics[i].pu8TopicPathStr, &xTopicHash);
+		if (PS_RESULT_OK != result) return result;
+		TopicsArray[xTopicHash].xDtype = pxTopics[i].xDtype;
+		if (0 != pxTopics[i].xMaxMsgLen) {
+			if (0 == ps_is_capacity_served(pxTopics[i].xMaxMsgLen)) return PS_RESULT_OUT_OF_MEM;
+			TopicsArray[xTopicHash].xMaxMsgLen = pxTopics[i].xMaxMsgLen;
+		}
+		if (pxTopics[i].u8Sticky_flag && (PS_RESULT_OK != ps_make_topic_sticky(xTopicHash))) return PS_RESULT_OUT_OF_MEM;
+		if (NULL != pxTopics[i].pu8TopicInfoStr) {
+			strncpy(TopicsColdArray[xTopicHash].pu8TopicInfoStr, pxTopics[i].pu8TopicInfoStr, sizeof(TopicsColdArray[xTopicHash].pu8TopicInfoStr));
+		}
+	}
+	for (size_t i = 0; i < xLinksCount; i++) {
+		if (pxLinks[i].xTopicHash >= xTopicsCount) return PS_RESULT_NOT_FOUND;
+		PsResultType_e result = pxLinks[i].u8PublisherFlag ?
+			ps_add_topic_publisher(pxLinks[i].xTopicHash, pxLinks[i].pxActorHandler) :
+			ps_add_topic_subscriber(pxLinks[i].xTopicHash, pxLinks[i].pxActorHandler, PS_SUB_FLAG_EXPLICIT);
+		if (PS_RESULT_ERROR == result) return result;
+	}
+	return PS_RESULT_OK;
+}
+
 PsResultType_e ps_pub_topic_with_registration(actor_f pxActorHandler, PsDataType_e xDataType, const char * pu8TopicPathStr, const char * pu8TopicInfoStr, uint8_t u8Sticky_flag, PsMsgLen_t xMsgLen, void * pvData, PsTopicHash_t * pxTopicHash) {
 	PsTopicHash_t topic_hash;
 	//register new topic if necessary
@@ -199,81 +1053,752 @@ PsResultType_e ps_pub_topic_with_registration(actor_f pxActorHandler, PsDataType
 }
 
 PsResultType_e ps_manage_topic(PsTopicHash_t xTopicHash) {
-	if (NULL == TopicsArray[xTopicHash].pu8TopicPathStr) return PS_RESULT_NOT_FOUND;
-	//check if we still have publishers for the topic
-	for (PsActorId_t i = 0; i < PS_MAX_ACTORS_COUNT; i++) {
-		if (NULL != TopicsArray[xTopicHash].pxPublishers[i]) {
-			//found active publisher, don't remove topic
-			return PS_RESULT_OK;
-		}
-	}
-	//no active publishers found, check if we still have subscribers for the topic
-	for (PsActorId_t i = 0; i < PS_MAX_ACTORS_COUNT; i++) {
-		if (NULL != TopicsArray[xTopicHash].pxPublishers[i]) {
-			//found active subscriber, don't remove topic
-			return PS_RESULT_OK;
-		}
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
+	//check if we still have publishers or subscribers for the topic (wildcard subscribers don't keep topics alive)
+	if ((0 != TopicsArray[xTopicHash].xPublishers) || (0 != TopicsColdArray[xTopicHash].xExplicitSubscribers)) {
+		return PS_RESULT_OK;
 	}
 	//no active publishers or subscribers - remove topic to free slot in the topic array
 	ps_report_topic_change(xTopicHash, "DEL");
 	if (xTopic_tpc_cnhg == xTopicHash) {
 		u8Topic_tpc_cnhg_present_flag = 0;
 	}
-	memset(&TopicsArray[xTopicHash], 0, sizeof(TopicsArray[xTopicHash]));
+	ps_remove_topic(xTopicHash);
 	return PS_RESULT_OK;
 }
 
 PsResultType_e ps_unregister_topic_publisher(actor_f pxActorHandler, PsTopicHash_t xTopicHash) {
-	PsActorId_t xActorIdx = 0;
-	//we already have this topic registered, just add subscriber
-	if (NULL == TopicsArray[xTopicHash].pu8TopicPathStr) return PS_RESULT_NOT_FOUND;
-	if (PS_RESULT_ERROR != ps_find_actor(TopicsArray[xTopicHash].pxPublishers, pxActorHandler, &xActorIdx)) {
-		TopicsArray[xTopicHash].pxPublishers[xActorIdx] = NULL;
-		TopicsArray[xTopicHash].u8PublishersMute[xActorIdx] = 0;
+	//we already have this topic registered, just remove publisher
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
+	PsActorSet_t xActorBit = ps_actor_bit(pxActorHandler);
+	if (TopicsArray[xTopicHash].xPublishers & xActorBit) {
+		TopicsArray[xTopicHash].xPublishers &= ~xActorBit;
+		TopicsArray[xTopicHash].xPublishersMute &= ~xActorBit;
 		return ps_manage_topic(xTopicHash);
 	}
 	return PS_RESULT_ERROR;
 }
 
+#if PS_PRODUCER_QUEUES_COUNT
+//returns 1 if the calling thread owns a producer queue claimed after the last ps_init().
+uint8_t ps_has_thread_queue() {
+	return (uint8_t)((NULL != pxThreadMsgQueue) && (u32ThreadQueueEpoch == xProducerQueuesEpoch.load(std::memory_order_relaxed)));
+}
+#endif
+
+//returns message queue of the priority class of the calling context, NULL if it has no queue.
+CQ_S * ps_get_pub_queue(uint8_t u8Priority) {
+#if PS_PRODUCER_QUEUES_COUNT
+	if (0 == ps_has_thread_queue()) {
+		//first publishing from this thread - claim a free queue, it belongs to the thread till ps_release_producer_queue() or the thread exit
+		pxThreadMsgQueue = NULL;
+		uint32_t u32Claimed = xProducerQueuesClaimed.load();
+		uint8_t u8QueueIdx;
+		do {
+			uint32_t u32Free = ~u32Claimed & PS_PRODUCER_QUEUES_MASK;
+			if (0 == u32Free) return NULL;
+			u8QueueIdx = ps_lowest_actor(u32Free);
+		} while (!xProducerQueuesClaimed.compare_exchange_weak(u32Claimed, u32Claimed | ((uint32_t)1 << u8QueueIdx)));
+		pxThreadMsgQueue = &msg_queues[u8QueueIdx * PS_PRIORITY_LEVELS_COUNT];
+		u32ThreadQueueEpoch = xProducerQueuesEpoch.load(std::memory_order_relaxed);
+		(void)&xThreadQueueGuard; //first use of the guard registers its destructor for the thread exit
+	}
+	return pxThreadMsgQueue + u8Priority;
+#else
+	return &msg_queues[u8Priority];
+#endif
+}
+
+//returns queue ps_get_pub_queue() would return without claiming it, so it may be taken by another thread before publishing.
+CQ_S * ps_find_pub_queue(uint8_t u8Priority) {
+#if PS_PRODUCER_QUEUES_COUNT
+	if (ps_has_thread_queue()) return pxThreadMsgQueue + u8Priority;
+	uint32_t u32Free = ~xProducerQueuesClaimed.load() & PS_PRODUCER_QUEUES_MASK;
+	if (0 == u32Free) return NULL;
+	return &msg_queues[ps_lowest_actor(u32Free) * PS_PRIORITY_LEVELS_COUNT + u8Priority];
+#else
+	return &msg_queues[u8Priority];
+#endif
+}
+
+void ps_release_producer_queue() {
+#if PS_PRODUCER_QUEUES_COUNT
+	if (ps_has_thread_queue()) {
+		uint8_t u8QueueIdx = (uint8_t)((pxThreadMsgQueue - msg_queues) / PS_PRIORITY_LEVELS_COUNT);
+		xProducerQueuesClaimed.fetch_and(~((uint32_t)1 << u8QueueIdx));
+	}
+	pxThreadMsgQueue = NULL;
+#endif
+}
+
+//returns queue to be dispatched by its index, ISR queue (if enabled) goes after the message queues.
+CQ_S * ps_get_dispatch_queue(uint8_t u8QueueIdx) {
+#if PS_ISR_MSG_QUEUE_BUF_SIZE
+	if (PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT == u8QueueIdx) return &msg_isr_queue;
+#endif
+	return &msg_queues[u8QueueIdx];
+}
+
+//returns count of queues of the priority class: one per producer, the highest class also owns the ISR queue.
+uint8_t ps_level_queues_count(uint8_t u8Level) {
+	return (PS_PRIORITY_LEVELS_COUNT - 1 == u8Level) ? (PS_DISPATCH_QUEUES_COUNT - PS_MSG_QUEUES_COUNT * (PS_PRIORITY_LEVELS_COUNT - 1)) : PS_MSG_QUEUES_COUNT;
+}
+
+//returns dispatch index of the i-th queue of the priority class.
+uint8_t ps_level_queue_idx(uint8_t u8Level, uint8_t i) {
+	return (i < PS_MSG_QUEUES_COUNT) ? (uint8_t)(i * PS_PRIORITY_LEVELS_COUNT + u8Level) : (uint8_t)(PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT);
+}
+
+uint8_t ps_is_level_pending(uint8_t u8Level) {
+	for (uint8_t i = 0; i < ps_level_queues_count(u8Level); i++) {
+		if (cq_count(ps_get_dispatch_queue(ps_level_queue_idx(u8Level, i)))) return 1;
+	}
+	return 0;
+}
+
+//returns dispatch index of the queue.
+uint8_t ps_dispatch_queue_idx(const CQ_S * pxQueue) {
+#if PS_ISR_MSG_QUEUE_BUF_SIZE
+	if (&msg_isr_queue == pxQueue) return PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT;
+#endif
+	return (uint8_t)(pxQueue - msg_queues);
+}
+
+uint8_t ps_exchange_queue_flag(PsQueueFlag_t * pxFlag, uint8_t u8Value) {
+#if CQ_CFG_LOCK_FREE_SPSC
+	return pxFlag->exchange(u8Value);
+#else
+	uint8_t u8OldValue = *pxFlag;
+	*pxFlag = u8Value;
+	return u8OldValue;
+#endif
+}
+
+//sets (u8SetFlag = 1) or clears bits of u8Mask in the flags.
+void ps_update_queue_flags(PsQueueFlag_t * pxFlags, uint8_t u8Mask, uint8_t u8SetFlag) {
+#if CQ_CFG_LOCK_FREE_SPSC
+	if (u8SetFlag) (void)pxFlags->fetch_or(u8Mask); else (void)pxFlags->fetch_and((uint8_t)~u8Mask);
+#else
+	if (u8SetFlag) *pxFlags |= u8Mask; else *pxFlags &= (uint8_t)~u8Mask;
+#endif
+}
+
+//marks priority class of the queue as pending, called in the publisher context after posting a message.
+void ps_set_level_pending(CQ_S * pxQueue) {
+#if (PS_PRIORITY_LEVELS_COUNT > 1)
+	uint8_t u8QueueIdx = ps_dispatch_queue_idx(pxQueue);
+	uint8_t u8Level = (PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT == u8QueueIdx) ? (PS_PRIORITY_LEVELS_COUNT - 1) : (u8QueueIdx % PS_PRIORITY_LEVELS_COUNT);
+	ps_update_queue_flags(&xPendingLevels, (uint8_t)(1u << u8Level), 1);
+#else
+	(void)pxQueue;
+#endif
+}
+
+//reports the queue filled up to the high watermark, called in the publisher context after posting a message.
+void ps_check_high_watermark(CQ_S * pxQueue) {
+	if ((NULL == queue_watermark) || (cq_usedSpace(pxQueue) * 100 < (size_t)u8HighWatermarkPercent * pxQueue->totalSize)) return;
+	uint8_t u8QueueIdx = ps_dispatch_queue_idx(pxQueue);
+	if (0 == ps_exchange_queue_flag(&QueueAboveHighFlags[u8QueueIdx], 1)) {
+		queue_watermark((PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT == u8QueueIdx) ? PS_PRIORITY_LEVELS_COUNT : (u8QueueIdx % PS_PRIORITY_LEVELS_COUNT), 1);
+	}
+}
+
+//reports the queue drained below the low watermark, called by ps_loop() after removing dispatched messages.
+void ps_check_low_watermark(CQ_S * pxQueue) {
+	if ((NULL == queue_watermark) || (cq_usedSpace(pxQueue) * 100 >= (size_t)u8LowWatermarkPercent * pxQueue->totalSize)) return;
+	uint8_t u8QueueIdx = ps_dispatch_queue_idx(pxQueue);
+	if (0 != ps_exchange_queue_flag(&QueueAboveHighFlags[u8QueueIdx], 0)) {
+		queue_watermark((PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT == u8QueueIdx) ? PS_PRIORITY_LEVELS_COUNT : (u8QueueIdx % PS_PRIORITY_LEVELS_COUNT), 0);
+	}
+}
+
+//ends sleep of ps_idle(), called in the publisher context after posting a message.
+void ps_cancel_idle() {
+	if (NULL == enter_sleep) return;
+	PS_IDLE_FENCE(); //posted message is visible to ps_idle() before its state is read
+	if (PS_IDLE_SLEEPING != xIdleState) return;
+	if ((PS_IDLE_SLEEPING == ps_exchange_queue_flag(&xIdleState, PS_IDLE_CANCELLED)) && (NULL != cancel_sleep)) {
+		cancel_sleep();
+	}
+}
+
+//releases payload pool block or loaned block of the message which is dropped without dispatching.
+void ps_release_msg(const CQ_REGION_S * pxMsgRegion) {
+	PsMsgStructHdr_s xHdr;
+	(void)cq_copyFromRegion(pxMsgRegion, 0, &xHdr, sizeof(xHdr));
+#if PS_LOAN_BLOCKS_COUNT
+	if (xHdr.xTopicHash & PS_MSG_FLAG_LOANED) {
+		PsLoanRefStruct_s xLoanRef;
+		(void)cq_copyFromRegion(pxMsgRegion, sizeof(xHdr), &xLoanRef, sizeof(xLoanRef));
+		ps_unref_loan_block(xLoanRef.xBlock);
+	} else
+#endif
+	if (xHdr.xTopicHash & PS_MSG_FLAG_POOLED) {
+		PsPoolBlock_t xBlock;
+		xHdr.xTopicHash &= ~PS_MSG_FLAG_POOLED;
+		(void)cq_copyFromRegion(pxMsgRegion, sizeof(xHdr), &xBlock, sizeof(xBlock));
+		PS_POOL_LOCK();
+		if (xBlock == TopicsColdArray[xHdr.xTopicHash].xPendingBlock) TopicsColdArray[xHdr.xTopicHash].xPendingBlock = PS_POOL_BLOCK_NONE;
+		PS_POOL_UNLOCK();
+		ps_pool_free(xBlock);
+	}
+}
+
+//drops the oldest message of the topic (of any topic if xTopicHash is PS_TOPIC_NONE) waiting in the queue, returns 0 if there is no such message.
+uint8_t ps_drop_oldest_msg(CQ_S * pxQueue, PsTopicHash_t xTopicHash) {
+	CQ_CURSOR_S xCursor;
+	CQ_CURSOR_S xMsgCursor;
+	CQ_REGION_S xMsgRegion;
+	PsMsgStructHdr_s xHdr;
+	cq_cursorInit(pxQueue, &xCursor);
+	do {
+		xMsgCursor = xCursor;
+		if (0 == cq_cursorNext(pxQueue, &xCursor, &xMsgRegion)) return 0;
+		(void)cq_copyFromRegion(&xMsgRegion, 0, &xHdr, sizeof(xHdr));
+	} while ((PS_TOPIC_NONE != xTopicHash) && (xTopicHash != (xHdr.xTopicHash & ~(PS_MSG_FLAG_POOLED | PS_MSG_FLAG_LOANED))));
+	ps_release_msg(&xMsgRegion);
+	return (0 != cq_deleteElement(pxQueue, &xMsgCursor));
+}
+
+//applies overflow policy of the topic when its message of xElemSize bytes doesn't fit into the queue, returns 1 if the message fits now.
+uint8_t ps_make_msg_space(CQ_S * pxQueue, PsTopicHash_t xTopicHash, size_t xElemSize) {
+	PsTopicColdStruct_s * pxTopicCold = &TopicsColdArray[xTopicHash];
+	switch (pxTopicCold->u8OverflowPolicy) {
+#if PS_PRODUCER_QUEUES_COUNT
+	case PS_OVERFLOW_BLOCK: {
+		//ps_loop() of another thread makes space, the thread of ps_loop() (or its subscriber) would only wait till the timeout
+		if (u8LoopThreadFlag) return 0;
+		//timer tick restarts on every timer expiry, so the wait is measured by the monotonic clock
+		std::chrono::steady_clock::time_point xDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(pxTopicCold->u16BlockTimeoutMs);
+		while (!cq_hasSpace(pxQueue, xElemSize)) {
+			if (std::chrono::steady_clock::now() >= xDeadline) return 0;
+			std::this_thread::yield();
+		}
+		return 1;
+	}
+#else
+	case PS_OVERFLOW_DROP_OLDEST:
+	case PS_OVERFLOW_OVERWRITE_OLDEST: {
+		//messages can't be dropped while ps_loop() walks them, and there is no sense to drop anything for a message larger than the queue
+		if ((pxQueue == pxDispatchingQueue) || (xElemSize + sizeof(CQ_ELEM_HEADER_S) > pxQueue->totalSize)) return 0;
+		PsTopicHash_t xDroppedTopic = (PS_OVERFLOW_DROP_OLDEST == pxTopicCold->u8OverflowPolicy) ? xTopicHash : PS_TOPIC_NONE;
+		while (!cq_hasSpace(pxQueue, xElemSize)) {
+			if (0 == ps_drop_oldest_msg(pxQueue, xDroppedTopic)) return 0;
+		}
+		return 1;
+	}
+#endif
+	default:
+		return 0;
+	}
+}
+
+//returns result of publishing the message which doesn't fit into the queue.
+PsResultType_e ps_overflow_result(PsTopicHash_t xTopicHash) {
+	return (PS_OVERFLOW_DROP_NEWEST == TopicsColdArray[xTopicHash].u8OverflowPolicy) ? PS_RESULT_OK : PS_RESULT_OUT_OF_MEM;
+}
+
+//posts complete message of the topic into the queue applying overflow policy of the topic, returns 1 if posted.
+uint8_t ps_add_msg(CQ_S * pxQueue, PsTopicHash_t xTopicHash, void * pvMsg, size_t xElemSize) {
+	if (NULL == pxQueue) return 0;
+	if ((0 == cq_addTailElement(pxQueue, pvMsg, xElemSize)) &&
+		((0 == ps_make_msg_space(pxQueue, xTopicHash, xElemSize)) || (0 == cq_addTailElement(pxQueue, pvMsg, xElemSize)))) {
+		return 0;
+	}
+	ps_set_level_pending(pxQueue);
+	ps_check_high_watermark(pxQueue);
+	ps_cancel_idle();
+	return 1;
+}
+
+//reserves space of the message of the topic in the queue applying overflow policy of the topic, returns 1 if reserved.
+uint8_t ps_reserve_msg(CQ_S * pxQueue, PsTopicHash_t xTopicHash, size_t xElemSize, CQ_REGION_S * pxMsgRegion) {
+	if (NULL == pxQueue) return 0;
+	if (cq_reserveTail(pxQueue, xElemSize, pxMsgRegion)) return 1;
+	return ps_make_msg_space(pxQueue, xTopicHash, xElemSize) && cq_reserveTail(pxQueue, xElemSize, pxMsgRegion);
+}
+
+//calls subscribers of the topic one by one.
+void ps_notify_subscribers(PsTopicHash_t xTopicHash, void * pvPayload, PsMsgLen_t xMsgLen) {
+	PsTopicStruct_s * pxTopic = &TopicsArray[xTopicHash];
+	PsActorSet_t xPending = pxTopic->xSubscribers;
+	while (0 != xPending) {
+		PsActorId_t xActorId = ps_lowest_actor(xPending);
+		(void)ActorsArray[xActorId](xTopicHash, pvPayload, xMsgLen, pxTopic->xDtype);
+		//actor may change subscriptions, so take the rest of the set from the topic again
+		xPending = pxTopic->xSubscribers & ~((PS_ACTOR_BIT(xActorId) << 1) - 1);
+	}
+}
+
+//returns 1 if the message has to be delivered synchronously instead of posting it into the queue.
+uint8_t ps_is_inline_delivery(PsTopicHash_t xTopicHash) {
+	return TopicsArray[xTopicHash].u8Inline_flag && (u8InlineDepth < PS_MAX_INLINE_DEPTH);
+}
+
+//keeps the last message of the "sticky" topic.
+void ps_update_sticky_value(PsTopicHash_t xTopicHash, const void * pvPayload, PsMsgLen_t xMsgLen) {
+	if (TopicsArray[xTopicHash].u8Sticky_flag) {
+		ps_sticky_value(xTopicHash)->xMsgLen = xMsgLen;
+		memcpy(ps_sticky_payload(xTopicHash), pvPayload, xMsgLen);
+	}
+}
+
+//delivers message of the "inline" topic to subscribers right in the context of the publisher.
+void ps_deliver_inline(PsTopicHash_t xTopicHash, void * pvPayload, PsMsgLen_t xMsgLen) {
+	ps_update_sticky_value(xTopicHash, pvPayload, xMsgLen);
+	u8InlineDepth++;
+	ps_notify_subscribers(xTopicHash, pvPayload, xMsgLen);
+	u8InlineDepth--;
+}
+
+//publishes message of the "inline" topic, pvData must be aligned for the topic data type.
+PsResultType_e ps_pub_inline(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsMsgLen_t xMsgLen, void * pvData) {
+	PsTopicStruct_s * pxTopic = &TopicsArray[xTopicHash];
+	if (xPubReservation.u8Pending) return PS_RESULT_ERROR;
+	if (xMsgLen > pxTopic->xMaxMsgLen) return PS_RESULT_OUT_OF_MEM;
+	PsActorSet_t xActorBit = ps_actor_bit(pxActorHandler);
+	if (0 == (pxTopic->xPublishers & xActorBit)) return PS_RESULT_NOT_FOUND;
+	if (pxTopic->xPublishersMute & xActorBit) {
+		ps_update_sticky_value(xTopicHash, pvData, xMsgLen);
+	} else {
+		ps_deliver_inline(xTopicHash, pvData, xMsgLen);
+	}
+	return PS_RESULT_OK;
+}
+
+//posts value of the conflating topic: it's written over the value still waiting in the queue (which keeps its place there),
+//otherwise into a new block of the topic capacity which the queue gets reference to.
+PsResultType_e ps_post_conflated(PsTopicHash_t xTopicHash, const void * pvData, PsMsgLen_t xMsgLen) {
+	PsTopicColdStruct_s * pxTopicCold = &TopicsColdArray[xTopicHash];
+	PS_POOL_LOCK();
+	PsPoolBlock_t xBlock = pxTopicCold->xPendingBlock;
+	if ((PS_POOL_BLOCK_NONE != xBlock) && pxTopicCold->u8PendingPosted) {
+		memcpy(ps_pool_payload(xBlock), pvData, xMsgLen);
+		PayloadPool[xBlock].xHdr.xMsgLen = xMsgLen;
+		PS_POOL_UNLOCK();
+		return PS_RESULT_OK;
+	}
+	xBlock = ps_pool_take(TopicsArray[xTopicHash].xMaxMsgLen);
+	if (PS_POOL_BLOCK_NONE == xBlock) {
+		PS_POOL_UNLOCK();
+		return PS_RESULT_OUT_OF_MEM;
+	}
+	memcpy(ps_pool_payload(xBlock), pvData, xMsgLen);
+	PayloadPool[xBlock].xHdr.xMsgLen = xMsgLen;
+	//nobody writes into the block till its message is in the queue, so the failed post doesn't lose values of other producers.
+	//Value published while another producer posts its own one goes into a message of its own.
+	uint8_t u8PendingFlag = (PS_POOL_BLOCK_NONE == pxTopicCold->xPendingBlock);
+	if (u8PendingFlag) {
+		pxTopicCold->xPendingBlock = xBlock;
+		pxTopicCold->u8PendingPosted = 0;
+	}
+	PS_POOL_UNLOCK();
+	struct {
+		PsMsgStructHdr_s xHdr;
+		PsPoolBlock_t xBlock;
+	} xMsg;
+	CQ_S * pxQueue = ps_get_pub_queue(TopicsArray[xTopicHash].u8Priority);
+	xMsg.xHdr.xTopicHash = xTopicHash | PS_MSG_FLAG_POOLED;
+	xMsg.xBlock = xBlock;
+	uint8_t u8PostedFlag = ps_add_msg(pxQueue, xTopicHash, &xMsg, sizeof(xMsg));
+	PS_POOL_LOCK();
+	if (u8PendingFlag && (xBlock == pxTopicCold->xPendingBlock)) {
+		//the message could be already dispatched, then the block isn't pending anymore
+		if (u8PostedFlag) {
+			pxTopicCold->u8PendingPosted = 1;
+		} else {
+			pxTopicCold->xPendingBlock = PS_POOL_BLOCK_NONE;
+		}
+	}
+	PS_POOL_UNLOCK();
+	if (0 == u8PostedFlag) {
+		ps_pool_free(xBlock);
+		return ps_overflow_result(xTopicHash);
+	}
+	return PS_RESULT_OK;
+}
+
+//publishes value of the conflating topic straight from pvData.
+PsResultType_e ps_pub_conflated(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsMsgLen_t xMsgLen, const void * pvData) {
+	PsTopicStruct_s * pxTopic = &TopicsArray[xTopicHash];
+	if (xPubReservation.u8Pending) return PS_RESULT_ERROR;
+	if (xMsgLen > pxTopic->xMaxMsgLen) return PS_RESULT_OUT_OF_MEM;
+	PsActorSet_t xActorBit = ps_actor_bit(pxActorHandler);
+	if (0 == (pxTopic->xPublishers & xActorBit)) return PS_RESULT_NOT_FOUND;
+	if (0 == PS_STICKY_ON_DISPATCH) ps_update_sticky_value(xTopicHash, pvData, xMsgLen);
+	if (pxTopic->xPublishersMute & xActorBit) return PS_RESULT_OK;
+	return ps_post_conflated(xTopicHash, pvData, xMsgLen);
+}
+
+PsResultType_e ps_pub_topic_reserve(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsMsgLen_t xMaxMsgLen, CQ_REGION_S * pxRegion) {
+	if (xPubReservation.u8Pending) return PS_RESULT_ERROR;
+	if (xMaxMsgLen > TopicsArray[xTopicHash].xMaxMsgLen) return PS_RESULT_OUT_OF_MEM;
+	PsActorSet_t xActorBit = ps_actor_bit(pxActorHandler);
+	if (0 == (TopicsArray[xTopicHash].xPublishers & xActorBit)) return PS_RESULT_NOT_FOUND;
+	xPubReservation.u8Muted = (0 != (TopicsArray[xTopicHash].xPublishersMute & xActorBit));
+	xPubReservation.u8Conflated = (0 == xPubReservation.u8Muted) && TopicsArray[xTopicHash].u8Conflate_flag;
+	xPubReservation.xBlock = PS_POOL_BLOCK_NONE;
+	//muted publisher still can write its message, but it will not reach the queue.
+	//Value of the conflating topic is written aside too, it's copied into the queued value on commit.
+	void * pvPayload = xPubReservation.pu8MsgScratch;
+	PsMsgLen_t xQueuedLen = xMaxMsgLen;
+	if (xMaxMsgLen > PS_MAX_MESSAGE_PAYLOAD_LENGTH) {
+		//long payload is written into the payload pool, the queue carries only its block
+		xPubReservation.xBlock = ps_pool_alloc(xMaxMsgLen);
+		if (PS_POOL_BLOCK_NONE == xPubReservation.xBlock) return PS_RESULT_OUT_OF_MEM;
+		pvPayload = ps_pool_payload(xPubReservation.xBlock);
+		xQueuedLen = sizeof(PsPoolBlock_t);
+	}
+	if ((0 == xPubReservation.u8Muted) && (0 == xPubReservation.u8Conflated)) {
+		xPubReservation.pxQueue = ps_get_pub_queue(TopicsArray[xTopicHash].u8Priority);
+		if (0 == ps_reserve_msg(xPubReservation.pxQueue, xTopicHash, sizeof(PsMsgStructHdr_s) + xQueuedLen, &xPubReservation.xMsgRegion)) {
+			if (PS_RESULT_OK != ps_overflow_result(xTopicHash)) {
+				if (PS_POOL_BLOCK_NONE != xPubReservation.xBlock) ps_pool_free(xPubReservation.xBlock);
+				return PS_RESULT_OUT_OF_MEM;
+			}
+			xPubReservation.u8Muted = 1; //dropped message is written as muted one, so it doesn't reach the queue
+		}
+	}
+	if ((0 == xPubReservation.u8Muted) && (0 == xPubReservation.u8Conflated) && (PS_POOL_BLOCK_NONE == xPubReservation.xBlock)) {
+		cq_subRegion(&xPubReservation.xMsgRegion, sizeof(PsMsgStructHdr_s), &xPubReservation.xPayloadRegion);
+	} else {
+		xPubReservation.xPayloadRegion.pFirst = pvPayload;
+		xPubReservation.xPayloadRegion.firstSize = xMaxMsgLen;
+		xPubReservation.xPayloadRegion.pSecond = NULL;
+		xPubReservation.xPayloadRegion.secondSize = 0;
+	}
+	xPubReservation.xTopicHash = xTopicHash;
+	xPubReservation.xMaxMsgLen = xMaxMsgLen;
+	xPubReservation.u8Pending = 1;
+	*pxRegion = xPubReservation.xPayloadRegion;
+	return PS_RESULT_OK;
+}
+
+PsResultType_e ps_pub_topic_commit(PsMsgLen_t xMsgLen) {
+	if (0 == xPubReservation.u8Pending) return PS_RESULT_ERROR;
+	xPubReservation.u8Pending = 0;
+	PsPoolBlock_t xBlock = xPubReservation.xBlock;
+	uint8_t u8Reserved = (0 == xPubReservation.u8Muted) && (0 == xPubReservation.u8Conflated); //the queue space is reserved
+	if (xMsgLen > xPubReservation.xMaxMsgLen) {
+		if (u8Reserved) (void)cq_commitTail(xPubReservation.pxQueue, 0);
+		if (PS_POOL_BLOCK_NONE != xBlock) ps_pool_free(xBlock);
+		return PS_RESULT_ERROR;
+	}
+	if ((0 == PS_STICKY_ON_DISPATCH) && TopicsArray[xPubReservation.xTopicHash].u8Sticky_flag) {
+		//keep the last message for new subscribers of the "sticky" topic
+		ps_sticky_value(xPubReservation.xTopicHash)->xMsgLen = xMsgLen;
+		(void)cq_copyFromRegion(&xPubReservation.xPayloadRegion, 0, ps_sticky_payload(xPubReservation.xTopicHash), xMsgLen);
+	}
+	if (xPubReservation.u8Muted) {
+		if (PS_POOL_BLOCK_NONE != xBlock) ps_pool_free(xBlock);
+		return PS_RESULT_OK;
+	}
+	if (ps_is_inline_delivery(xPubReservation.xTopicHash)) {
+		//message is delivered at once, so its place in the queue is given back.
+		//The payload is copied out first: subscribers publishing into the queue reuse that place.
+		uint64_t pu64Payload[(PS_MAX_MESSAGE_PAYLOAD_LENGTH + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+		void * pvPayload = pu64Payload;
+		if (PS_POOL_BLOCK_NONE != xBlock) {
+			pvPayload = ps_pool_payload(xBlock);
+		} else {
+			(void)cq_copyFromRegion(&xPubReservation.xPayloadRegion, 0, pu64Payload, xMsgLen);
+		}
+		if (u8Reserved) (void)cq_commitTail(xPubReservation.pxQueue, 0);
+		ps_deliver_inline(xPubReservation.xTopicHash, pvPayload, xMsgLen);
+		if (PS_POOL_BLOCK_NONE != xBlock) ps_pool_free(xBlock);
+		return PS_RESULT_OK;
+	}
+	if (xPubReservation.u8Conflated) {
+		void * pvPayload = (PS_POOL_BLOCK_NONE != xBlock) ? ps_pool_payload(xBlock) : xPubReservation.pu8MsgScratch;
+		PsResultType_e result = ps_post_conflated(xPubReservation.xTopicHash, pvPayload, xMsgLen);
+		if (PS_POOL_BLOCK_NONE != xBlock) ps_pool_free(xBlock);
+		return result;
+	}
+	PsMsgStructHdr_s xHdr;
+	PsMsgLen_t xQueuedLen = xMsgLen;
+	xHdr.xTopicHash = xPubReservation.xTopicHash;
+	if (PS_POOL_BLOCK_NONE != xBlock) {
+		PayloadPool[xBlock].xHdr.xMsgLen = xMsgLen;
+		xHdr.xTopicHash |= PS_MSG_FLAG_POOLED;
+		(void)cq_copyToRegion(&xPubReservation.xMsgRegion, sizeof(xHdr), &xBlock, sizeof(xBlock));
+		xQueuedLen = sizeof(xBlock);
+	}
+	(void)cq_copyToRegion(&xPubReservation.xMsgRegion, 0, &xHdr, sizeof(xHdr));
+	if (0 == cq_commitTail(xPubReservation.pxQueue, sizeof(xHdr) + xQueuedLen)) {
+		if (PS_POOL_BLOCK_NONE != xBlock) ps_pool_free(xBlock);
+		return PS_RESULT_ERROR;
+	}
+	ps_set_level_pending(xPubReservation.pxQueue);
+	ps_check_high_watermark(xPubReservation.pxQueue);
+	ps_cancel_idle();
+	return PS_RESULT_OK;
+}
+
+//returns size of the scalar data type, 0 for other types.
+PsMsgLen_t ps_dtype_scalar_size(PsDataType_e xDataType) {
+	switch (xDataType) {
+	case PS_DTYPE_U8:
+	case PS_DTYPE_I8:
+	case PS_DTYPE_BOOL:
+		return sizeof(uint8_t);
+	case PS_DTYPE_U16:
+	case PS_DTYPE_I16:
+		return sizeof(uint16_t);
+	case PS_DTYPE_U32:
+	case PS_DTYPE_I32:
+		return sizeof(uint32_t);
+	case PS_DTYPE_U64:
+	case PS_DTYPE_I64:
+		return sizeof(uint64_t);
+	default:
+		return 0;
+	}
+}
+
+//posts message of up to 8 bytes without reservation, pxMsg payload must be already filled.
+PsResultType_e ps_pub_short_msg(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsShortMsgStruct_s * pxMsg, PsMsgLen_t xMsgLen) {
+	if (xPubReservation.u8Pending) return PS_RESULT_ERROR;
+	PsTopicStruct_s * pxTopic = &TopicsArray[xTopicHash];
+	if (xMsgLen > pxTopic->xMaxMsgLen) return PS_RESULT_OUT_OF_MEM;
+	PsActorSet_t xActorBit = ps_actor_bit(pxActorHandler);
+	if (0 == (pxTopic->xPublishers & xActorBit)) return PS_RESULT_NOT_FOUND;
+	if (ps_is_inline_delivery(xTopicHash)) {
+		uint64_t u64Data; //aligned copy of the value
+		memcpy(&u64Data, pxMsg->pu8Data, xMsgLen);
+		return ps_pub_inline(pxActorHandler, xTopicHash, xMsgLen, &u64Data);
+	}
+	if (pxTopic->u8Conflate_flag) {
+		return ps_pub_topic(pxActorHandler, xTopicHash, xMsgLen, pxMsg->pu8Data); //value goes through the payload pool
+	}
+	if (0 == (pxTopic->xPublishersMute & xActorBit)) {
+		pxMsg->xHdr.xTopicHash = xTopicHash;
+		if (0 == ps_add_msg(ps_get_pub_queue(pxTopic->u8Priority), xTopicHash, pxMsg, sizeof(pxMsg->xHdr) + xMsgLen)) {
+			return ps_overflow_result(xTopicHash);
+		}
+	}
+	if ((0 == PS_STICKY_ON_DISPATCH) && pxTopic->u8Sticky_flag) {
+		//keep the last message for new subscribers of the "sticky" topic
+		ps_sticky_value(xTopicHash)->xMsgLen = xMsgLen;
+		memcpy(ps_sticky_payload(xTopicHash), pxMsg->pu8Data, xMsgLen);
+	}
+	return PS_RESULT_OK;
+}
+
+PsResultType_e ps_pub_scalar(actor_f pxActorHandler, PsTopicHash_t xTopicHash, uint64_t u64Value) {
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
+	PsShortMsgStruct_s xMsg;
+	PsMsgLen_t xMsgLen = ps_dtype_scalar_size(TopicsArray[xTopicHash].xDtype);
+	//value is stored in native byte order, as if the publisher passed pointer to a variable of the topic type
+	switch (xMsgLen) {
+	case sizeof(uint8_t): {
+		uint8_t u8Value = (uint8_t)u64Value;
+		memcpy(xMsg.pu8Data, &u8Value, sizeof(u8Value));
+		break;
+	}
+	case sizeof(uint16_t): {
+		uint16_t u16Value = (uint16_t)u64Value;
+		memcpy(xMsg.pu8Data, &u16Value, sizeof(u16Value));
+		break;
+	}
+	case sizeof(uint32_t): {
+		uint32_t u32Value = (uint32_t)u64Value;
+		memcpy(xMsg.pu8Data, &u32Value, sizeof(u32Value));
+		break;
+	}
+	case sizeof(uint64_t):
+		memcpy(xMsg.pu8Data, &u64Value, sizeof(u64Value));
+		break;
+	default:
+		return PS_RESULT_ERROR;
+	}
+	return ps_pub_short_msg(pxActorHandler, xTopicHash, &xMsg, xMsgLen);
+}
+
 PsResultType_e ps_pub_topic(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsMsgLen_t xMsgLen, void * pvData){
-	if (NULL == TopicsArray[xTopicHash].pu8TopicPathStr) return PS_RESULT_NOT_FOUND;
-	TopicsArray[xTopicHash].xLastMsg.xHdr.xTopicHash = xTopicHash;
-	TopicsArray[xTopicHash].xLastMsg.xHdr.xMsgLen = xMsgLen;
-	if(NULL != pvData) memcpy(TopicsArray[xTopicHash].xLastMsg.pu8Data, pvData, sizeof(TopicsArray[xTopicHash].xLastMsg.pu8Data));
-	//publish
-	PsActorId_t xActorIdx = 0;
-	PsResultType_e result = ps_find_actor(TopicsArray[xTopicHash].pxPublishers, pxActorHandler, &xActorIdx);
-	if(PS_RESULT_OK != result) {
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
+	if ((NULL != pvData) && ps_is_inline_delivery(xTopicHash)) {
+		return ps_pub_inline(pxActorHandler, xTopicHash, xMsgLen, pvData);
+	}
+	if ((NULL != pvData) && TopicsArray[xTopicHash].u8Conflate_flag) {
+		return ps_pub_conflated(pxActorHandler, xTopicHash, xMsgLen, pvData);
+	}
+	if ((NULL != pvData) && (xMsgLen <= sizeof(uint64_t))) {
+		PsShortMsgStruct_s xMsg;
+		memcpy(xMsg.pu8Data, pvData, xMsgLen);
+		return ps_pub_short_msg(pxActorHandler, xTopicHash, &xMsg, xMsgLen);
+	}
+	//serialize the message directly into the queue buffer
+	CQ_REGION_S xRegion;
+	PsResultType_e result = ps_pub_topic_reserve(pxActorHandler, xTopicHash, xMsgLen, &xRegion);
+	if (PS_RESULT_OK != result) {
 		return result;
 	}
-	if (0 == TopicsArray[xTopicHash].u8PublishersMute[xActorIdx]) {
-		if (0 == cq_addTailElement(&msg_queue, (void*)&TopicsArray[xTopicHash].xLastMsg, sizeof(TopicsArray[xTopicHash].xLastMsg.xHdr) + xMsgLen)) {
-			return PS_RESULT_OUT_OF_MEM;
+	if (NULL != pvData) {
+		(void)cq_copyToRegion(&xRegion, 0, pvData, xMsgLen);
+	} else if (TopicsArray[xTopicHash].u8Sticky_flag) {
+		//publishing without data re-posts the last message of the topic
+		(void)cq_copyToRegion(&xRegion, 0, ps_sticky_payload(xTopicHash), xMsgLen);
+	} else {
+		memset(xRegion.pFirst, 0, xRegion.firstSize);
+		if (NULL != xRegion.pSecond) memset(xRegion.pSecond, 0, xRegion.secondSize);
+	}
+	return ps_pub_topic_commit(xMsgLen);
+}
+#if PS_LOAN_BLOCKS_COUNT
+//returns block of the loaned buffer, PS_LOAN_BLOCK_NONE if the pointer isn't start of a loaned block.
+PsLoanBlock_t ps_loan_block(const void * pvBuffer) {
+	uintptr_t xOffset = (uintptr_t)pvBuffer - (uintptr_t)LoanBlocksArray;
+	if (((uintptr_t)pvBuffer < (uintptr_t)LoanBlocksArray) || (xOffset >= sizeof(LoanBlocksArray)) || (0 != xOffset % sizeof(LoanBlocksArray[0]))) {
+		return PS_LOAN_BLOCK_NONE;
+	}
+	return (PsLoanBlock_t)(xOffset / sizeof(LoanBlocksArray[0]));
+}
+
+//drops one owner of the block, the last one returns it to the pool.
+void ps_unref_loan_block(PsLoanBlock_t xBlock) {
+	PS_POOL_LOCK();
+	if (0 == --LoanRefsArray[xBlock]) {
+		LoanFreeList[xLoanFreeCount++] = xBlock;
+	}
+	PS_POOL_UNLOCK();
+}
+
+void * ps_loan_buffer() {
+	void * pvBuffer = NULL;
+	PS_POOL_LOCK();
+	if (0 != xLoanFreeCount) {
+		PsLoanBlock_t xBlock = LoanFreeList[--xLoanFreeCount];
+		LoanRefsArray[xBlock] = 1;
+		pvBuffer = LoanBlocksArray[xBlock];
+	}
+	PS_POOL_UNLOCK();
+	return pvBuffer;
+}
+
+PsResultType_e ps_pub_loaned_buffer(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsMsgLen_t xMsgLen, void * pvBuffer) {
+	PsLoanRefStruct_s xRef;
+	xRef.xBlock = ps_loan_block(pvBuffer);
+	xRef.xMsgLen = xMsgLen;
+	if ((PS_LOAN_BLOCK_NONE == xRef.xBlock) || xPubReservation.u8Pending) return PS_RESULT_ERROR;
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
+	PsTopicStruct_s * pxTopic = &TopicsArray[xTopicHash];
+	if ((xMsgLen > PS_LOAN_BLOCK_SIZE) || (xMsgLen > pxTopic->xMaxMsgLen)) return PS_RESULT_OUT_OF_MEM;
+	PsActorSet_t xActorBit = ps_actor_bit(pxActorHandler);
+	if (0 == (pxTopic->xPublishers & xActorBit)) return PS_RESULT_NOT_FOUND;
+	if (ps_is_inline_delivery(xTopicHash)) {
+		PsResultType_e result = ps_pub_inline(pxActorHandler, xTopicHash, xMsgLen, pvBuffer);
+		if (PS_RESULT_OK == result) ps_unref_loan_block(xRef.xBlock);
+		return result;
+	}
+	if (0 == (pxTopic->xPublishersMute & xActorBit)) {
+		//message takes over the publisher's ownership of the block
+		struct {
+			PsMsgStructHdr_s xHdr;
+			PsLoanRefStruct_s xRef;
+		} xMsg;
+		xMsg.xHdr.xTopicHash = xTopicHash | PS_MSG_FLAG_LOANED;
+		xMsg.xRef = xRef;
+		if (0 == ps_add_msg(ps_get_pub_queue(pxTopic->u8Priority), xTopicHash, &xMsg, sizeof(xMsg))) {
+			PsResultType_e result = ps_overflow_result(xTopicHash);
+			if (PS_RESULT_OK == result) ps_unref_loan_block(xRef.xBlock); //dropped message takes over the block as well
+			return result;
 		}
 	}
+	if ((0 == PS_STICKY_ON_DISPATCH) && pxTopic->u8Sticky_flag) {
+		//keep the last message for new subscribers of the "sticky" topic
+		ps_sticky_value(xTopicHash)->xMsgLen = xMsgLen;
+		memcpy(ps_sticky_payload(xTopicHash), pvBuffer, xMsgLen);
+	}
+	if (pxTopic->xPublishersMute & xActorBit) ps_unref_loan_block(xRef.xBlock);
 	return PS_RESULT_OK;
 }
+
+PsResultType_e ps_retain_buffer(const void * pvBuffer) {
+	PsLoanBlock_t xBlock = ps_loan_block(pvBuffer);
+	if (PS_LOAN_BLOCK_NONE == xBlock) return PS_RESULT_ERROR;
+	PsResultType_e result = PS_RESULT_OK;
+	PS_POOL_LOCK();
+	if ((0 == LoanRefsArray[xBlock]) || (UINT8_MAX == LoanRefsArray[xBlock])) {
+		result = PS_RESULT_ERROR;
+	} else {
+		LoanRefsArray[xBlock]++;
+	}
+	PS_POOL_UNLOCK();
+	return result;
+}
+
+PsResultType_e ps_release_buffer(const void * pvBuffer) {
+	PsLoanBlock_t xBlock = ps_loan_block(pvBuffer);
+	if (PS_LOAN_BLOCK_NONE == xBlock) return PS_RESULT_ERROR;
+	PsResultType_e result = PS_RESULT_OK;
+	PS_POOL_LOCK();
+	if (0 == LoanRefsArray[xBlock]) {
+		result = PS_RESULT_ERROR;
+	} else if (0 == --LoanRefsArray[xBlock]) {
+		LoanFreeList[xLoanFreeCount++] = xBlock;
+	}
+	PS_POOL_UNLOCK();
+	return result;
+}
+#endif
+#if PS_ISR_MSG_QUEUE_BUF_SIZE
+PsResultType_e ps_pub_topic_from_isr(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsMsgLen_t xMsgLen, void * pvData) {
+	if ((xMsgLen > PS_MAX_MESSAGE_PAYLOAD_LENGTH) || (xMsgLen > TopicsArray[xTopicHash].xMaxMsgLen)) return PS_RESULT_OUT_OF_MEM;
+	PsActorSet_t xActorBit = ps_actor_bit(pxActorHandler);
+	if (0 == (TopicsArray[xTopicHash].xPublishers & xActorBit)) return PS_RESULT_NOT_FOUND;
+	if (TopicsArray[xTopicHash].xPublishersMute & xActorBit) return PS_RESULT_OK;
+	//we are the only producer of the ISR queue and ps_loop() is its only consumer, so no locking is needed
+	CQ_REGION_S xMsgRegion;
+	PsMsgStructHdr_s xHdr;
+	xHdr.xTopicHash = xTopicHash;
+	if (0 == cq_reserveTail(&msg_isr_queue, sizeof(xHdr) + xMsgLen, &xMsgRegion)) {
+		return PS_RESULT_OUT_OF_MEM;
+	}
+	(void)cq_copyToRegion(&xMsgRegion, 0, &xHdr, sizeof(xHdr));
+	if (NULL != pvData) {
+		(void)cq_copyToRegion(&xMsgRegion, sizeof(xHdr), pvData, xMsgLen);
+	} else {
+		//like ps_pub_topic() without data, but "sticky" value isn't re-posted as it's updated by ps_loop() concurrently
+		CQ_REGION_S xPayloadRegion;
+		cq_subRegion(&xMsgRegion, sizeof(xHdr), &xPayloadRegion);
+		memset(xPayloadRegion.pFirst, 0, xPayloadRegion.firstSize);
+		if (NULL != xPayloadRegion.pSecond) memset(xPayloadRegion.pSecond, 0, xPayloadRegion.secondSize);
+	}
+	(void)cq_commitTail(&msg_isr_queue, sizeof(xHdr) + xMsgLen);
+	ps_set_level_pending(&msg_isr_queue);
+	ps_check_high_watermark(&msg_isr_queue);
+	ps_cancel_idle();
+	return PS_RESULT_OK;
+}
+#endif
+
 PsResultType_e ps_sub_single_topic(const char * pu8TopicPathStr, PsDataType_e xDataType, actor_f pxActorHandler, PsTopicHash_t * pxTopicHash, void** pvMsg, size_t * pxMsgLendth, PsDataType_e * pxMsgDataType) {
 	PsTopicHash_t xTopicHash;
+	if (NULL != ps_find_wildcard_segment(pu8TopicPathStr)) {
+		//wildcard subscription isn't bound to a single topic
+		return ps_sub_wildcard_topic(pu8TopicPathStr, pxActorHandler);
+	}
 	//check if we already have the topic
 	PsResultType_e result = ps_find_topic(pu8TopicPathStr, &xTopicHash);
 	//if not - create it before subscribing
 	if (PS_RESULT_NOT_FOUND == result) {
 		//create topic without publisher
-		PsResultType_e result = ps_find_topic(NULL, &xTopicHash);
+		PsResultType_e result = ps_create_topic(pu8TopicPathStr, &xTopicHash);
 		if (PS_RESULT_OK != result) return result;
 		// just add subscriber to an incomplete topic (we don't have data type,"sticky" flag and info str)
-		strncpy(TopicsArray[xTopicHash].pu8TopicPathStr, pu8TopicPathStr, sizeof(TopicsArray[xTopicHash].pu8TopicPathStr));
 		TopicsArray[xTopicHash].xDtype = xDataType;
+		ps_apply_wildcard_subs(xTopicHash);
 		ps_report_topic_change(xTopicHash, "ADD");
-	}	
+	} else if (PS_RESULT_OK != result) {
+		return result;
+	}
 	//we have the topic - subscribe
 	if(NULL != pxTopicHash) *pxTopicHash = xTopicHash;
-	if (PS_RESULT_ERROR != ps_register_actor(TopicsArray[xTopicHash].pxSubscribers, pxActorHandler, NULL)) {
+	if (PS_RESULT_OK == ps_add_topic_subscriber(xTopicHash, pxActorHandler, PS_SUB_FLAG_EXPLICIT)) {
 		if ((NULL != pvMsg)&&(NULL != pxMsgLendth)&&(NULL != pxMsgDataType)&&(TopicsArray[xTopicHash].u8Sticky_flag)) {
 			//we have "sticky" topic, so inform subscriber about data currently available for the topic
-			*pvMsg = TopicsArray[xTopicHash].xLastMsg.pu8Data;
-			*pxMsgLendth = TopicsArray[xTopicHash].xLastMsg.xHdr.xMsgLen;
+			*pvMsg = ps_sticky_payload(xTopicHash);
+			*pxMsgLendth = ps_sticky_value(xTopicHash)->xMsgLen;
 			*pxMsgDataType = TopicsArray[xTopicHash].xDtype;
 		}
 		return PS_RESULT_OK;
@@ -282,14 +1807,15 @@ PsResultType_e ps_sub_single_topic(const char * pu8TopicPathStr, PsDataType_e xD
 }
 
 PsResultType_e ps_unsub_topic(const char * pu8TopicPathStr, actor_f pxActorHandler) {
-	PsActorId_t xActorIdx = 0;
 	PsTopicHash_t xTopicHash;
+	if (NULL != ps_find_wildcard_segment(pu8TopicPathStr)) {
+		return ps_unsub_wildcard_topic(pu8TopicPathStr, pxActorHandler);
+	}
 	PsResultType_e result = ps_find_topic(pu8TopicPathStr, &xTopicHash);
 	if (PS_RESULT_OK != result) return result;
 	//we found the topic, remove subscriber
-	if (NULL == TopicsArray[xTopicHash].pu8TopicPathStr) return PS_RESULT_NOT_FOUND;
-	if (PS_RESULT_ERROR != ps_find_actor(TopicsArray[xTopicHash].pxSubscribers, pxActorHandler, &xActorIdx)) {
-		TopicsArray[xTopicHash].pxSubscribers[xActorIdx] = NULL;
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
+	if (PS_RESULT_OK == ps_remove_topic_subscriber(xTopicHash, pxActorHandler, PS_SUB_FLAG_EXPLICIT)) {
 		return ps_manage_topic(xTopicHash);
 	}
 	return PS_RESULT_ERROR;
@@ -301,16 +1827,18 @@ PsResultType_e ps_check_topic(const char * pu8TopicPathStr, PsDataType_e * pxDat
 	if (PS_RESULT_OK != result) return result;
 	//we found the topic
 	*pxTopicHash = xTopicHash;
-	strncpy(pu8TopicInfoStr, TopicsArray[xTopicHash].pu8TopicInfoStr, sizeof(TopicsArray[xTopicHash].pu8TopicInfoStr));
+	strncpy(pu8TopicInfoStr, TopicsColdArray[xTopicHash].pu8TopicInfoStr, sizeof(TopicsColdArray[xTopicHash].pu8TopicInfoStr));
 	*pxDataType = TopicsArray[xTopicHash].xDtype;
 	return PS_RESULT_OK;
 }
 
-PsResultType_e ps_check_topic_by_hash(PsTopicHash_t xTopicHash, const char ** ppu8TopicPathStr, const char ** ppu8TopicInfoStr, PsDataType_e * pxDataType) {
-	if (NULL == TopicsArray[xTopicHash].pu8TopicPathStr) return PS_RESULT_NOT_FOUND;
+PsResultType_e ps_check_topic_by_hash(PsTopicHash_t xTopicHash, char * pu8TopicPathStr, const char ** ppu8TopicInfoStr, PsDataType_e * pxDataType) {
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
 	//we found the topic
-	if (NULL != ppu8TopicPathStr) *ppu8TopicPathStr = (const char *)TopicsArray[xTopicHash].pu8TopicPathStr;
-	if (NULL != ppu8TopicInfoStr) *ppu8TopicInfoStr = (const char *)TopicsArray[xTopicHash].pu8TopicInfoStr;
+	if (NULL != pu8TopicPathStr) {
+		(void)ps_build_topic_path(TopicsArray[xTopicHash].xNode, pu8TopicPathStr, PS_MAX_TOPIC_PATH_STR_LENGTH);
+	}
+	if (NULL != ppu8TopicInfoStr) *ppu8TopicInfoStr = (const char *)TopicsColdArray[xTopicHash].pu8TopicInfoStr;
 	if (NULL != pxDataType) *pxDataType = TopicsArray[xTopicHash].xDtype;
 	return PS_RESULT_OK;
 }
@@ -319,26 +1847,188 @@ const char * ps_check_subscriber(actor_f pxSubscriber) {
 	return pxSubscriber(0, NULL, 0, PS_DTYPE_NONE);
 }
 
-//returns -1 if failed, otherwise - count of messages in the queue.
-int16_t ps_loop() {
-	PsMsgStruct_s msg;
-	unsigned int processed_messages_count = 0;
+//returns pointer to the message payload: directly in the queue buffer if it's contiguous and aligned, otherwise - copied into pvCopyBuf.
+void * ps_map_msg_payload(const CQ_REGION_S * pxMsgRegion, PsMsgLen_t xMsgLen, PsDataType_e xDataType, void * pvCopyBuf) {
+	CQ_REGION_S xPayloadRegion;
+	cq_subRegion(pxMsgRegion, sizeof(PsMsgStructHdr_s), &xPayloadRegion);
+	if ((xPayloadRegion.firstSize >= xMsgLen) && (0 == ((uintptr_t)xPayloadRegion.pFirst % ps_dtype_alignment(xDataType)))) {
+		return xPayloadRegion.pFirst;
+	}
+	(void)cq_copyFromRegion(&xPayloadRegion, 0, pvCopyBuf, xMsgLen);
+	return pvCopyBuf;
+}
+
+//dispatches message located in the queue buffer to subscribers.
+void ps_dispatch_msg(const CQ_REGION_S * pxMsgRegion, size_t xElemLen, uint8_t u8UpdateStickyFlag) {
+	PsMsgStructHdr_s xHdr;
+	uint64_t pu64WrappedPayload[(PS_MAX_MESSAGE_PAYLOAD_LENGTH + sizeof(uint64_t) - 1) / sizeof(uint64_t)]; //used only if inline payload wraps in the queue buffer
+	PsPoolBlock_t xBlock = PS_POOL_BLOCK_NONE;
+#if PS_LOAN_BLOCKS_COUNT
+	PsLoanRefStruct_s xLoanRef = { PS_LOAN_BLOCK_NONE, 0 };
+#endif
+	PsMsgLen_t xMsgLen;
+	void * pvPayload;
+	(void)cq_copyFromRegion(pxMsgRegion, 0, &xHdr, sizeof(xHdr));
+#if PS_LOAN_BLOCKS_COUNT
+	if (xHdr.xTopicHash & PS_MSG_FLAG_LOANED) {
+		//subscribers get the loaned buffer itself, the message owns it till all of them return
+		xHdr.xTopicHash &= ~PS_MSG_FLAG_LOANED;
+		(void)cq_copyFromRegion(pxMsgRegion, sizeof(xHdr), &xLoanRef, sizeof(xLoanRef));
+		xMsgLen = xLoanRef.xMsgLen;
+		pvPayload = LoanBlocksArray[xLoanRef.xBlock];
+	} else
+#endif
+	if (xHdr.xTopicHash & PS_MSG_FLAG_POOLED) {
+		//long payload is contiguous in the payload pool, so it's passed to subscribers in place
+		xHdr.xTopicHash &= ~PS_MSG_FLAG_POOLED;
+		(void)cq_copyFromRegion(pxMsgRegion, sizeof(xHdr), &xBlock, sizeof(xBlock));
+		PS_POOL_LOCK();
+		//value of the conflating topic leaves the queue, newer values go into a new message
+		if (xBlock == TopicsColdArray[xHdr.xTopicHash].xPendingBlock) TopicsColdArray[xHdr.xTopicHash].xPendingBlock = PS_POOL_BLOCK_NONE;
+		xMsgLen = PayloadPool[xBlock].xHdr.xMsgLen;
+		PS_POOL_UNLOCK();
+		pvPayload = ps_pool_payload(xBlock);
+	} else {
+		xMsgLen = (PsMsgLen_t)(xElemLen - sizeof(xHdr));
+		if (xMsgLen > sizeof(pu64WrappedPayload)) xMsgLen = sizeof(pu64WrappedPayload);
+		pvPayload = ps_map_msg_payload(pxMsgRegion, xMsgLen, TopicsArray[xHdr.xTopicHash].xDtype, pu64WrappedPayload);
+	}
+	PsTopicStruct_s * pxTopic = &TopicsArray[xHdr.xTopicHash];
+	if (u8UpdateStickyFlag && pxTopic->u8Sticky_flag && (xMsgLen <= ps_pool_capacity(TopicsColdArray[xHdr.xTopicHash].xStickyBlock))) {
+		ps_sticky_value(xHdr.xTopicHash)->xMsgLen = xMsgLen;
+		memcpy(ps_sticky_payload(xHdr.xTopicHash), pvPayload, xMsgLen);
+	}
+	ps_notify_subscribers(xHdr.xTopicHash, pvPayload, xMsgLen);
+	if (PS_POOL_BLOCK_NONE != xBlock) ps_pool_free(xBlock);
+#if PS_LOAN_BLOCKS_COUNT
+	if (PS_LOAN_BLOCK_NONE != xLoanRef.xBlock) ps_unref_loan_block(xLoanRef.xBlock);
+#endif
+}
+
+uint8_t ps_is_budget_spent(uint8_t u8TimedFlag, uint32_t u32StartUs, uint32_t u32BudgetUs) {
+	return u8TimedFlag && ((uint32_t)(get_time_us() - u32StartUs) >= u32BudgetUs);
+}
+
+//returns 1 if a class higher than u8Level has messages, so dispatching of u8Level has to give way.
+//Queues are looked at only for classes marked pending, the mark is dropped before the look, so a message posted meanwhile sets it again.
+uint8_t ps_is_preempted(uint8_t u8Level) {
+#if (PS_PRIORITY_LEVELS_COUNT > 1)
+	uint8_t u8Higher = (uint8_t)(xPendingLevels >> (u8Level + 1));
+	for (uint8_t u8Bit = u8Level + 1; 0 != u8Higher; u8Bit++, u8Higher >>= 1) {
+		if (0 == (u8Higher & 1)) continue;
+		ps_update_queue_flags(&xPendingLevels, (uint8_t)(1u << u8Bit), 0);
+		if (ps_is_level_pending(u8Bit)) {
+			ps_update_queue_flags(&xPendingLevels, (uint8_t)(1u << u8Bit), 1);
+			return 1;
+		}
+	}
+#else
+	(void)u8Level;
+#endif
+	return 0;
+}
+
+//dispatches up to u16MaxMsgs messages from the front of the queue of the priority class u8Level, each one is removed from the queue
+//as soon as its subscribers return, so actors publishing during a long batch get its space. Stops earlier if a higher class gets messages.
+//Returns count of processed messages.
+uint16_t ps_dispatch_batch(CQ_S * pxQueue, uint8_t u8Level, uint8_t u8UpdateStickyFlag, uint16_t u16MaxMsgs, uint8_t u8TimedFlag, uint32_t u32StartUs, uint32_t u32BudgetUs) {
+	CQ_REGION_S xMsgRegion;
+	size_t xElemLen;
+	uint16_t u16Count = 0;
 	//if we are the only consumer for the queue, we can consider extracting elements as thread safe.
-	if (cq_getFrontElement(&msg_queue, &msg, sizeof(msg))) {
-		for (PsActorId_t u16Actor_idx = 0;u16Actor_idx < PS_MAX_ACTORS_COUNT;u16Actor_idx++) {
-			actor_f actor = TopicsArray[msg.xHdr.xTopicHash].pxSubscribers[u16Actor_idx];
-			if (NULL != actor) {
-				(void)actor(msg.xHdr.xTopicHash, msg.pu8Data, msg.xHdr.xMsgLen, TopicsArray[msg.xHdr.xTopicHash].xDtype);
-			}
-		}	
-		cq_deleteFrontElement(&msg_queue);
-		processed_messages_count++;
+	pxDispatchingQueue = pxQueue;
+	while ((u16Count < u16MaxMsgs) && (0 != (xElemLen = cq_peekFront(pxQueue, &xMsgRegion)))) {
+		ps_dispatch_msg(&xMsgRegion, xElemLen, u8UpdateStickyFlag);
+		(void)cq_deleteFrontElements(pxQueue, 1);
+		u16Count++;
+		if (ps_is_budget_spent(u8TimedFlag, u32StartUs, u32BudgetUs) || ps_is_preempted(u8Level)) break;
+	}
+	pxDispatchingQueue = NULL;
+	ps_check_low_watermark(pxQueue);
+	return u16Count;
+}
+
+//returns the highest priority class with messages that didn't spend its quota, -1 if all queues are empty.
+int8_t ps_next_priority_level() {
+	int8_t i8SpentLevel = -1;
+	for (int8_t i8Level = PS_PRIORITY_LEVELS_COUNT - 1; i8Level >= 0; i8Level--) {
+		if (0 == ps_is_level_pending((uint8_t)i8Level)) continue;
+		if ((0 == i8Level) || (0 == PS_PRIORITY_QUOTA(i8Level)) || (u16LevelStreak[i8Level] < PS_PRIORITY_QUOTA(i8Level))) return i8Level;
+		if (i8SpentLevel < 0) i8SpentLevel = i8Level;
 	}
-	return processed_messages_count;
+	//no lower class is waiting for the turn, so the class starts a new quota
+	if (i8SpentLevel >= 0) u16LevelStreak[i8SpentLevel] = 0;
+	return i8SpentLevel;
+}
+
+//dispatches up to u16MaxMsgs messages of the priority class taking its queues (one per producer) in turn, so none of them can starve another one.
+uint16_t ps_dispatch_level(uint8_t u8Level, uint16_t u16MaxMsgs, uint8_t u8TimedFlag, uint32_t u32StartUs, uint32_t u32BudgetUs) {
+	static uint8_t pu8QueueTurn[PS_PRIORITY_LEVELS_COUNT] = { 0, };
+	uint8_t u8QueuesCount = ps_level_queues_count(u8Level);
+	uint16_t u16Processed = 0;
+	uint8_t u8IdleQueues = 0;
+	while ((u16Processed < u16MaxMsgs) && (u8IdleQueues < u8QueuesCount)) {
+		pu8QueueTurn[u8Level] = (pu8QueueTurn[u8Level] + 1) % u8QueuesCount;
+		uint8_t u8QueueIdx = ps_level_queue_idx(u8Level, pu8QueueTurn[u8Level]);
+		uint16_t u16Batch = ps_dispatch_batch(ps_get_dispatch_queue(u8QueueIdx), u8Level,
+			PS_STICKY_ON_DISPATCH || (u8QueueIdx >= PS_MSG_QUEUES_COUNT * PS_PRIORITY_LEVELS_COUNT), u16MaxMsgs - u16Processed, u8TimedFlag, u32StartUs, u32BudgetUs);
+		u8IdleQueues = u16Batch ? 0 : (u8IdleQueues + 1);
+		u16Processed += u16Batch;
+		if (u16Batch && (ps_is_budget_spent(u8TimedFlag, u32StartUs, u32BudgetUs) || ps_is_preempted(u8Level))) break;
+	}
+	return u16Processed;
+}
+
+int16_t ps_loop_batch(uint16_t u16MaxMsgs, uint8_t u8TimedFlag, uint32_t u32BudgetUs, int16_t * pi16Remaining) {
+#if PS_PRODUCER_QUEUES_COUNT
+	u8LoopThreadFlag = 1;
+#endif
+	uint32_t u32StartUs = u8TimedFlag ? get_time_us() : 0;
+	uint16_t u16Processed = 0;
+	int8_t i8Level;
+	if (u16MaxMsgs > INT16_MAX) u16MaxMsgs = INT16_MAX;
+	//the highest class goes first, the class that spent its quota lets one message of the lower classes through
+	while ((u16Processed < u16MaxMsgs) && (0 <= (i8Level = ps_next_priority_level()))) {
+		uint16_t u16Limit = u16MaxMsgs - u16Processed;
+		if ((0 != i8Level) && (0 != PS_PRIORITY_QUOTA(i8Level)) && (u16Limit > PS_PRIORITY_QUOTA(i8Level) - u16LevelStreak[i8Level])) {
+			u16Limit = PS_PRIORITY_QUOTA(i8Level) - u16LevelStreak[i8Level];
+		}
+		uint16_t u16Batch = ps_dispatch_level((uint8_t)i8Level, u16Limit, u8TimedFlag, u32StartUs, u32BudgetUs);
+		u16LevelStreak[i8Level] += u16Batch;
+		for (uint8_t u8Higher = (uint8_t)i8Level + 1; u8Higher < PS_PRIORITY_LEVELS_COUNT; u8Higher++) {
+			u16LevelStreak[u8Higher] = 0; //lower class got its turn
+		}
+		u16Processed += u16Batch;
+		if (u16Batch && ps_is_budget_spent(u8TimedFlag, u32StartUs, u32BudgetUs)) break;
+	}
+	if (NULL != pi16Remaining) *pi16Remaining = ps_get_waiting_events_count();
+	return (int16_t)u16Processed;
+}
+
+//returns -1 if failed, otherwise - count of processed events.
+int16_t ps_loop() {
+	return ps_loop_batch(1, 0, 0, NULL);
+}
+
+int16_t ps_loop_n(uint16_t u16MaxMsgs, int16_t * pi16Remaining) {
+	return ps_loop_batch(u16MaxMsgs, 0, 0, pi16Remaining);
+}
+
+int16_t ps_loop_for(uint32_t u32BudgetUs, int16_t * pi16Remaining) {
+	if (NULL == get_time_us) return -1;
+	return ps_loop_batch(UINT16_MAX, 1, u32BudgetUs, pi16Remaining);
+}
+
+void ps_set_time_us_source(get_time_us_f pxGet_time_us) {
+	get_time_us = pxGet_time_us;
 }
 
 int16_t ps_get_waiting_events_count() {
-	return cq_count(&msg_queue);
+	int16_t i16Count = 0;
+	for (uint8_t i = 0; i < PS_DISPATCH_QUEUES_COUNT; i++) {
+		i16Count += cq_count(ps_get_dispatch_queue(i));
+	}
+	return i16Count;
 }
 
 uint8_t ps_str_starts_with(const char *prefix, const char *str)
@@ -354,12 +2044,188 @@ uint8_t ps_str_starts_with(const char *prefix, const char *str)
 	return 1;
 }
 
+//returns index of the highest set bit, u32Bits must not be 0.
+uint8_t ps_highest_bit(uint32_t u32Bits) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (uint8_t)(31 - __builtin_clz(u32Bits));
+#elif defined(_MSC_VER)
+	unsigned long u32Idx;
+	_BitScanReverse(&u32Idx, u32Bits);
+	return (uint8_t)u32Idx;
+#else
+	uint8_t u8Idx = 0;
+	while (u32Bits >>= 1) u8Idx++;
+	return u8Idx;
+#endif
+}
+
+//rotates set of wheel slots by u8Shift slots towards higher ones.
+uint32_t ps_rotate_slots(uint32_t u32Slots, uint8_t u8Shift) {
+	u8Shift &= PS_TIMER_WHEEL_MASK;
+	return (u32Slots << u8Shift) | (u32Slots >> ((PS_TIMER_WHEEL_SLOTS - u8Shift) & PS_TIMER_WHEEL_MASK));
+}
+
+void ps_timer_link(PsTimerId_t xTimer, uint8_t u8Slot) {
+	PsTimerStruct_s * pxTimer = &TimersArray[xTimer];
+	pxTimer->u8Slot = u8Slot;
+	pxTimer->xPrev = PS_TIMER_NONE;
+	pxTimer->xNext = TimerSlotsArray[u8Slot];
+	if (PS_TIMER_NONE != pxTimer->xNext) TimersArray[pxTimer->xNext].xPrev = xTimer;
+	TimerSlotsArray[u8Slot] = xTimer;
+	if (u8Slot < PS_TIMER_SLOT_DUE) {
+		uint32_t u32Expiry = (uint32_t)pxTimer->u64Expiry_ms;
+		if ((PS_TIMER_NONE == pxTimer->xNext) || ((int32_t)(u32Expiry - TimerSlotsExpiry[u8Slot]) < 0)) TimerSlotsExpiry[u8Slot] = u32Expiry;
+		TimerPendingSlots[u8Slot / PS_TIMER_WHEEL_SLOTS] |= (uint32_t)1 << (u8Slot & PS_TIMER_WHEEL_MASK);
+	}
+}
+
+void ps_timer_unlink(PsTimerId_t xTimer) {
+	PsTimerStruct_s * pxTimer = &TimersArray[xTimer];
+	uint8_t u8Slot = pxTimer->u8Slot;
+	if (PS_TIMER_SLOT_NONE == u8Slot) return;
+	if (PS_TIMER_NONE != pxTimer->xNext) TimersArray[pxTimer->xNext].xPrev = pxTimer->xPrev;
+	if (PS_TIMER_NONE != pxTimer->xPrev) {
+		TimersArray[pxTimer->xPrev].xNext = pxTimer->xNext;
+	} else {
+		TimerSlotsArray[u8Slot] = pxTimer->xNext;
+		if ((PS_TIMER_NONE == pxTimer->xNext) && (u8Slot < PS_TIMER_SLOT_DUE)) {
+			TimerPendingSlots[u8Slot / PS_TIMER_WHEEL_SLOTS] &= ~((uint32_t)1 << (u8Slot & PS_TIMER_WHEEL_MASK));
+		}
+	}
+	pxTimer->u8Slot = PS_TIMER_SLOT_NONE;
+}
+
+//puts the timer into the wheel slot by its expiry. Level is chosen by time left (slot of the level N is 32^N ms long),
+//timers of upper levels are put one slot earlier, so they are moved to a lower level before they expire.
+void ps_timer_schedule(PsTimerId_t xTimer) {
+	uint64_t u64Expiry = TimersArray[xTimer].u64Expiry_ms;
+	if (u64Expiry <= u64TimerWheelNow_ms) {
+		ps_timer_link(xTimer, PS_TIMER_SLOT_DUE);
+		return;
+	}
+	uint64_t u64Left = u64Expiry - u64TimerWheelNow_ms;
+	if (u64Left > PS_TIMER_WHEEL_MAX_MS) u64Left = PS_TIMER_WHEEL_MAX_MS;
+	uint8_t u8Level = ps_highest_bit((uint32_t)u64Left) / PS_TIMER_WHEEL_BITS;
+	uint8_t u8Slot = PS_TIMER_WHEEL_MASK & (uint8_t)((u64Expiry >> (u8Level * PS_TIMER_WHEEL_BITS)) - (u8Level ? 1 : 0));
+	ps_timer_link(xTimer, u8Level * PS_TIMER_WHEEL_SLOTS + u8Slot);
+}
+
+//moves wheel time forward: timers of the slots passed on every level are collected into the due list,
+//then expired timers publish their events (periodic ones are scheduled again) and others go to lower levels.
+void ps_timer_advance(uint64_t u64Now) {
+	uint64_t u64Elapsed = u64Now - u64TimerWheelNow_ms;
+	for (uint8_t u8Level = 0; u8Level < PS_TIMER_WHEEL_LEVELS; u8Level++) {
+		uint8_t u8Shift = u8Level * PS_TIMER_WHEEL_BITS;
+		uint32_t u32Passed;
+		if ((u64Elapsed >> u8Shift) > PS_TIMER_WHEEL_MASK) {
+			u32Passed = UINT32_MAX; //the whole level turned around
+		} else {
+			//slots from the old slot of the level (included) to the new one (included)
+			uint8_t u8Steps = (uint8_t)(PS_TIMER_WHEEL_MASK & (u64Elapsed >> u8Shift));
+			uint8_t u8OldSlot = (uint8_t)(PS_TIMER_WHEEL_MASK & (u64TimerWheelNow_ms >> u8Shift));
+			uint8_t u8NewSlot = (uint8_t)(PS_TIMER_WHEEL_MASK & (u64Now >> u8Shift));
+			uint32_t u32Steps = ((uint32_t)1 << u8Steps) - 1;
+			u32Passed = ps_rotate_slots(u32Steps, u8OldSlot);
+			u32Passed |= ps_rotate_slots(u32Steps, (uint8_t)(u8NewSlot - u8Steps));
+			u32Passed |= (uint32_t)1 << u8NewSlot;
+		}
+		while (u32Passed & TimerPendingSlots[u8Level]) {
+			uint8_t u8Slot = u8Level * PS_TIMER_WHEEL_SLOTS + (uint8_t)ps_lowest_actor(u32Passed & TimerPendingSlots[u8Level]);
+			while (PS_TIMER_NONE != TimerSlotsArray[u8Slot]) {
+				PsTimerId_t xTimer = TimerSlotsArray[u8Slot];
+				ps_timer_unlink(xTimer);
+				ps_timer_link(xTimer, PS_TIMER_SLOT_DUE);
+			}
+		}
+		if (0 == (u32Passed & 1)) break; //the level didn't pass its first slot, so upper levels didn't move
+		//upper level moves at least by one slot
+		if (u64Elapsed < ((uint64_t)PS_TIMER_WHEEL_SLOTS << u8Shift)) u64Elapsed = (uint64_t)PS_TIMER_WHEEL_SLOTS << u8Shift;
+	}
+	u64TimerWheelNow_ms = u64Now;
+	while (PS_TIMER_NONE != TimerSlotsArray[PS_TIMER_SLOT_DUE]) {
+		PsTimerId_t xTimer = TimerSlotsArray[PS_TIMER_SLOT_DUE];
+		PsTimerStruct_s * pxTimer = &TimersArray[xTimer];
+		ps_timer_unlink(xTimer);
+		if (pxTimer->u64Expiry_ms > u64Now) {
+			ps_timer_schedule(xTimer);
+			continue;
+		}
+		if (pxTimer->u32Period_ms) {
+			//periodic timer keeps its phase, periods missed by a late call are skipped
+			pxTimer->u64Expiry_ms += pxTimer->u32Period_ms;
+			if (pxTimer->u64Expiry_ms <= u64Now) pxTimer->u64Expiry_ms = u64Now + pxTimer->u32Period_ms;
+			ps_timer_schedule(xTimer);
+		}
+		//timer is scheduled before its event is published, so subscriber called inline may remove the timer topic
+		ps_pub_topic(pxTimer->xCreatorPublisher, pxTimer->u16Hash, PS_DTYPE_NONE, NULL);
+	}
+}
+
+//returns ms till the earliest expiry in the first non-empty slot of every level, -1 if there are no timers.
+//Slots of the top level may hold timers longer than the wheel, so they are counted from the slot where timers move to a lower level.
+long int ps_timer_next_deadline_ms() {
+	uint64_t u64Deadline = UINT64_MAX;
+	uint64_t u64LowerLevelsMask = 0;
+	for (uint8_t u8Level = 0; u8Level < PS_TIMER_WHEEL_LEVELS; u8Level++) {
+		uint8_t u8Shift = u8Level * PS_TIMER_WHEEL_BITS;
+		if (TimerPendingSlots[u8Level]) {
+			uint8_t u8NowSlot = (uint8_t)(PS_TIMER_WHEEL_MASK & (u64TimerWheelNow_ms >> u8Shift));
+			//slots of the level are counted from the current one, upper levels are one slot ahead (see ps_timer_schedule())
+			uint8_t u8Ahead = (uint8_t)ps_lowest_actor(ps_rotate_slots(TimerPendingSlots[u8Level], (uint8_t)(PS_TIMER_WHEEL_SLOTS - u8NowSlot)));
+			uint64_t u64LevelDeadline;
+			if ((0 == u8Level) || (PS_TIMER_WHEEL_LEVELS - 1 == u8Level)) {
+				u64LevelDeadline = ((uint64_t)(u8Ahead + (u8Level ? 1 : 0)) << u8Shift) - (u64TimerWheelNow_ms & u64LowerLevelsMask);
+			} else {
+				uint8_t u8Slot = u8Level * PS_TIMER_WHEEL_SLOTS + ((u8NowSlot + u8Ahead) & PS_TIMER_WHEEL_MASK);
+				u64LevelDeadline = (uint32_t)(TimerSlotsExpiry[u8Slot] - (uint32_t)u64TimerWheelNow_ms);
+			}
+			if (u64LevelDeadline < u64Deadline) u64Deadline = u64LevelDeadline;
+		}
+		u64LowerLevelsMask = (u64LowerLevelsMask << PS_TIMER_WHEEL_BITS) | PS_TIMER_WHEEL_MASK;
+	}
+	if (UINT64_MAX == u64Deadline) return -1;
+	return (u64Deadline > INT32_MAX) ? INT32_MAX : (long int)u64Deadline;
+}
+
+//adds time passed since the last restart_timer() call to the wheel time, may be called several times per restart.
+void ps_timer_update() {
+	long int lTick_ms = get_timer_tick_ms();
+	uint64_t u64Now = u64TimerWheelNow_ms;
+	if (lTick_ms > lTimerTickConsumed_ms) {
+		u64Now += (uint64_t)(lTick_ms - lTimerTickConsumed_ms);
+		lTimerTickConsumed_ms = lTick_ms;
+	}
+	ps_timer_advance(u64Now);
+}
+
+void ps_timer_restart() {
+	long int lDeadline_ms = ps_timer_next_deadline_ms();
+	lTimerTickConsumed_ms = 0;
+	if (0 == lDeadline_ms) lDeadline_ms = 1;
+	lTimerDeadline_ms = lDeadline_ms;
+	restart_timer((lDeadline_ms < 0) ? INT32_MAX : lDeadline_ms);
+}
+
+//returns ms till the deadline of the running timer, -1 if there are no timers.
+long int ps_timer_left_ms() {
+	if (lTimerDeadline_ms < 0) return -1;
+	long int lLeft_ms = lTimerDeadline_ms - get_timer_tick_ms();
+	return (lLeft_ms > 0) ? lLeft_ms : 0;
+}
+
+//cancels the timer of the removed timer topic.
+void ps_timer_free(PsTimerId_t xTimer) {
+	ps_timer_unlink(xTimer);
+	TimersArray[xTimer].xCreatorPublisher = NULL;
+	TimersFreeList[xTimersFreeCount++] = xTimer;
+}
+
 //timer topic must have at least one subscriber, otherwise it will be remowed automatically.
 PsResultType_e ps_create_and_sub_timer_topic(const char * pu8TopicPathStr, actor_f pxActorHandler, const char * pu8TopicInfoStr, long int tout_ms) {
 	//we want to create a new timer topic.
 	//a. check if this is a new timer topic, if not - return fail;
-	//b. find empty slot and add timer in the list;
-	//c. call ps_timer_tout_event() to check timers list in case we now have to resturt running timer;
+	//b. take a free timer and put it into the timer wheel;
+	//c. restart running timer in case the new timer expires first;
 	PsTopicHash_t xTopicHash;
 	//do a).
 	PsResultType_e result = ps_find_topic(pu8TopicPathStr, &xTopicHash);
@@ -371,6 +2237,8 @@ PsResultType_e ps_create_and_sub_timer_topic(const char * pu8TopicPathStr, actor
 		//we support only timer topic paths that start with either "tmr.ms.periodic" or "tmr.ms.single" 
 		return PS_RESULT_NOT_FOUND;
 	}
+	if (tout_ms <= 0) return PS_RESULT_ERROR;
+	if (0 == xTimersFreeCount) return PS_RESULT_OUT_OF_MEM;
 	result = ps_register_topic_publisher(pxActorHandler, PS_DTYPE_NONE, pu8TopicPathStr, pu8TopicInfoStr, false, &xTopicHash);
 	if (PS_RESULT_OK != result) return result;
 	void* pvMsg;
@@ -379,20 +2247,18 @@ PsResultType_e ps_create_and_sub_timer_topic(const char * pu8TopicPathStr, actor
 	result = ps_sub_single_topic(pu8TopicPathStr, PS_DTYPE_NONE, pxActorHandler, NULL, &pvMsg, &xMsgLendth, &xMsgDataType);
 	if (PS_RESULT_OK != result) return result;
 	//do b).
-	for (PsActorId_t i = 0; i < PS_MAX_ACTORS_COUNT; i++) {
-		if (0 == TimersArray[i].duration_ms) {
-			//found free slot
-			TimersArray[i].u16Hash = xTopicHash;
-			TimersArray[i].xCreatorPublisher = pxActorHandler;
-			TimersArray[i].duration_ms = tout_ms;
-			TimersArray[i].time_left_ms = tout_ms;
-			TimersArray[i].periodic_flag = periodic_flag;
-			//do c).
-			ps_pub_timer_tout_event();
-			return PS_RESULT_OK;
-		}
-	}
-	return PS_RESULT_OUT_OF_MEM;	
+	ps_timer_update(); //timeout is counted from the current time
+	PsTimerId_t xTimer = TimersFreeList[--xTimersFreeCount];
+	TimersArray[xTimer].u16Hash = xTopicHash;
+	TimersArray[xTimer].xCreatorPublisher = pxActorHandler;
+	TimersArray[xTimer].u32Period_ms = periodic_flag ? (uint32_t)tout_ms : 0;
+	TimersArray[xTimer].u64Expiry_ms = u64TimerWheelNow_ms + (uint64_t)tout_ms;
+	TimersArray[xTimer].u8Slot = PS_TIMER_SLOT_NONE;
+	TopicsColdArray[xTopicHash].xTimer = xTimer;
+	ps_timer_schedule(xTimer);
+	//do c).
+	ps_timer_restart();
+	return PS_RESULT_OK;
 }
 
 //topic.change [.tpc.cnhg] topic must have at least one subscriber, otherwise it will be remowed automatically.
@@ -418,59 +2284,120 @@ PsResultType_e ps_create_and_sub_tpc_change_topic(actor_f pxActorHandler) {
 }
 
 void ps_pub_timer_tout_event() {
-	//our timer has expired, process timers table.
-	//a) reduce all ticks_left variables in timers table by duration of the expired timer;
-	//b) send notification to all topic which timers have expired;
-	//c) start smallest timeout in the table;
-	long int current_tick_ms = get_timer_tick_ms();
-	long int shortest_timer_ms = INT32_MAX;
-	for (PsActorId_t i = 0; i < PS_MAX_ACTORS_COUNT; i++) {
-		if (0 == TimersArray[i].duration_ms) continue; //emtpy timer slot, skip it
-		//do a).
-		TimersArray[i].time_left_ms -= current_tick_ms;
-		//do b)
-		if (TimersArray[i].time_left_ms <= 0) {
-			//this timer expired, publish tout event
-			ps_pub_topic(TimersArray[i].xCreatorPublisher, TimersArray[i].u16Hash, PS_DTYPE_NONE, NULL);
-			//rewind timer if this is a periodic event
-			if (TimersArray[i].periodic_flag) {
-				TimersArray[i].time_left_ms = TimersArray[i].duration_ms;
-			}
-		}
-		//find shortest interval to start timer again
-		if (TimersArray[i].time_left_ms > 0) {
-			if (TimersArray[i].time_left_ms < shortest_timer_ms) {
-				shortest_timer_ms = TimersArray[i].time_left_ms;
-			}
-		}
-	}
-	//do c)
-	if (shortest_timer_ms != 0) {
-		//re-/start hw timer only if we have some timer topics running.
-		restart_timer(shortest_timer_ms);
+	//our timer has expired, process the timer wheel.
+	//a) move wheel time by the time passed, publish events of expired timers;
+	//b) start timer till the next deadline of the wheel;
+	ps_timer_update();
+	ps_timer_restart();
+}
+
+PsResultType_e ps_set_idle_hooks(enter_sleep_f pxEnterSleep, on_wakeup_f pxOnWakeup, cancel_sleep_f pxCancelSleep) {
+	enter_sleep = NULL; //producers don't call hooks being changed
+	on_wakeup = pxOnWakeup;
+	cancel_sleep = pxCancelSleep;
+	(void)ps_exchange_queue_flag(&xIdleState, PS_IDLE_AWAKE);
+	enter_sleep = pxEnterSleep;
+	return PS_RESULT_OK;
+}
+
+long int ps_get_idle_time_ms() {
+	if (ps_get_waiting_events_count() > 0) return 0;
+	long int lLeft_ms = ps_timer_left_ms();
+	return (lLeft_ms < 0) ? PS_IDLE_FOREVER : lLeft_ms;
+}
+
+uint8_t ps_idle() {
+	if (NULL == enter_sleep) return 0;
+	(void)ps_exchange_queue_flag(&xIdleState, PS_IDLE_SLEEPING);
+	PS_IDLE_FENCE(); //producers see the state before queues are checked, so a message posted after the check cancels the sleep
+	long int lSleep_ms = ps_get_idle_time_ms();
+	if (0 == lSleep_ms) {
+		(void)ps_exchange_queue_flag(&xIdleState, PS_IDLE_AWAKE);
+		if (0 == ps_timer_left_ms()) ps_pub_timer_tout_event();
+		return 0;
 	}
+	enter_sleep(lSleep_ms);
+	(void)ps_exchange_queue_flag(&xIdleState, PS_IDLE_AWAKE);
+	if (NULL != on_wakeup) on_wakeup();
+	if (0 == ps_timer_left_ms()) ps_pub_timer_tout_event();
+	return 1;
+}
+
+uint8_t ps_is_sleep_cancelled() {
+	return (uint8_t)(PS_IDLE_CANCELLED == xIdleState);
 }
 
 
-uint8_t ps_has_enough_msg_space(size_t bytes_to_publish) {
-	return (uint8_t)cq_hasSpace(&msg_queue, bytes_to_publish);
+uint8_t ps_has_enough_msg_space(PsTopicHash_t xTopicHash, size_t bytes_to_publish) {
+	if (0 == ps_is_topic_used(xTopicHash)) return 0;
+	CQ_S * pxQueue = ps_find_pub_queue(TopicsArray[xTopicHash].u8Priority);
+	return (uint8_t)((NULL != pxQueue) && cq_hasSpace(pxQueue, bytes_to_publish));
 }
 
 
 PsResultType_e ps_pub_mute(actor_f pxActorHandler, const char * pu8TopicPathStr, uint8_t u8MuteFlag) {
 	PsTopicHash_t xTopicHash;
-	PsActorId_t xActorIdx = 0;
 	PsResultType_e result = ps_find_topic(pu8TopicPathStr, &xTopicHash);
 	if (PS_RESULT_OK != result) return result;
 	return ps_pub_mute_by_hash(pxActorHandler, xTopicHash, u8MuteFlag);
 }
 
+PsResultType_e ps_set_topic_inline(PsTopicHash_t xTopicHash, uint8_t u8InlineFlag) {
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
+	TopicsArray[xTopicHash].u8Inline_flag = (0 != u8InlineFlag);
+	return PS_RESULT_OK;
+}
+
+PsResultType_e ps_set_topic_conflated(PsTopicHash_t xTopicHash, uint8_t u8ConflateFlag) {
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
+	PS_POOL_LOCK();
+	TopicsArray[xTopicHash].u8Conflate_flag = (0 != u8ConflateFlag);
+	TopicsColdArray[xTopicHash].xPendingBlock = PS_POOL_BLOCK_NONE; //value already waiting in the queue (if any) is not overwritten anymore
+	PS_POOL_UNLOCK();
+	return PS_RESULT_OK;
+}
+
+PsResultType_e ps_set_topic_overflow_policy(PsTopicHash_t xTopicHash, PsOverflowPolicy_e xPolicy, uint16_t u16TimeoutMs) {
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
+	if (xPolicy >= PS_OVERFLOW_COUNT) return PS_RESULT_ERROR;
+#if PS_PRODUCER_QUEUES_COUNT
+	//producer threads can't touch messages waiting in their queues, ps_loop() owns them
+	if ((PS_OVERFLOW_DROP_OLDEST == xPolicy) || (PS_OVERFLOW_OVERWRITE_OLDEST == xPolicy)) return PS_RESULT_ERROR;
+#else
+	//nobody else can make space while the only producer waits
+	if (PS_OVERFLOW_BLOCK == xPolicy) return PS_RESULT_ERROR;
+#endif
+	TopicsColdArray[xTopicHash].u8OverflowPolicy = (uint8_t)xPolicy;
+	TopicsColdArray[xTopicHash].u16BlockTimeoutMs = u16TimeoutMs;
+	return PS_RESULT_OK;
+}
+
+PsResultType_e ps_set_queue_watermarks(uint8_t u8HighPercent, uint8_t u8LowPercent, queue_watermark_f pxCallback) {
+	if ((NULL != pxCallback) && ((u8LowPercent >= u8HighPercent) || (u8HighPercent > 100))) return PS_RESULT_ERROR;
+	queue_watermark = NULL; //producers don't see callback with thresholds being changed
+	u8HighWatermarkPercent = u8HighPercent;
+	u8LowWatermarkPercent = u8LowPercent;
+	for (uint8_t i = 0; i < PS_DISPATCH_QUEUES_COUNT; i++) {
+		(void)ps_exchange_queue_flag(&QueueAboveHighFlags[i], 0);
+	}
+	queue_watermark = pxCallback;
+	return PS_RESULT_OK;
+}
+
+PsResultType_e ps_set_topic_priority(PsTopicHash_t xTopicHash, uint8_t u8Priority) {
+	if (0 == ps_is_topic_used(xTopicHash)) return PS_RESULT_NOT_FOUND;
+	if (u8Priority >= PS_PRIORITY_LEVELS_COUNT) return PS_RESULT_ERROR;
+	TopicsArray[xTopicHash].u8Priority = u8Priority;
+	return PS_RESULT_OK;
+}
+
 PsResultType_e ps_pub_mute_by_hash(actor_f pxActorHandler, PsTopicHash_t xTopicHash, uint8_t u8MuteFlag) {
-	PsActorId_t xActorIdx = 0;
-	PsResultType_e result = ps_find_actor(TopicsArray[xTopicHash].pxPublishers, pxActorHandler, &xActorIdx);
-	if (PS_RESULT_OK != result) {
-		return result;
+	PsActorSet_t xActorBit = ps_actor_bit(pxActorHandler);
+	if (0 == (TopicsArray[xTopicHash].xPublishers & xActorBit)) return PS_RESULT_NOT_FOUND;
+	if (u8MuteFlag) {
+		TopicsArray[xTopicHash].xPublishersMute |= xActorBit;
+	} else {
+		TopicsArray[xTopicHash].xPublishersMute &= ~xActorBit;
 	}
-	TopicsArray[xTopicHash].u8PublishersMute[xActorIdx] = u8MuteFlag;
 	return PS_RESULT_OK;
 }
\ No newline at end of file
@@ -29,19 +29,97 @@ please contact author via easyvolts@gmail.com for licensing options.
 ============================================================================
 */
 
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef PS_H
+#define PS_H
+
 #include <stdio.h>
 #include <stdint.h>
+#include "circular_queue.h"
 
+#ifndef PS_MAX_TOPICS_COUNT
 #define PS_MAX_TOPICS_COUNT					(3)
-#define PS_MAX_ACTORS_COUNT					(3)
+#endif
+//smallest power of 2 not less than x (1 < x <= 2^32), for default sizes of hash indexes.
+#define PS_POW2_SMEAR1(x)					((x) | ((x) >> 1))
+#define PS_POW2_SMEAR2(x)					(PS_POW2_SMEAR1(x) | (PS_POW2_SMEAR1(x) >> 2))
+#define PS_POW2_SMEAR4(x)					(PS_POW2_SMEAR2(x) | (PS_POW2_SMEAR2(x) >> 4))
+#define PS_POW2_SMEAR8(x)					(PS_POW2_SMEAR4(x) | (PS_POW2_SMEAR4(x) >> 8))
+#define PS_POW2_SMEAR16(x)					(PS_POW2_SMEAR8(x) | (PS_POW2_SMEAR8(x) >> 16))
+#define PS_POW2_CEIL(x)						(PS_POW2_SMEAR16((x) - 1) + 1)
+//max count of nodes in the topics tree (unique path segments between dots, root node included), less than 0xFFFF.
+//Default gives 8 segments per topic on average plus room for one path of PS_MAX_TOPIC_PATH_STR_LENGTH chars of any shape.
+#ifndef PS_MAX_TOPIC_NODES_COUNT
+#define PS_MAX_TOPIC_NODES_COUNT			((PS_MAX_TOPICS_COUNT * 8 + PS_MAX_TOPIC_PATH_STR_LENGTH + 1 < 0xFFFF) ? (PS_MAX_TOPICS_COUNT * 8 + PS_MAX_TOPIC_PATH_STR_LENGTH + 1) : 0xFFFE)
+#endif
+#ifndef PS_TOPIC_NODES_INDEX_SIZE
+#define PS_TOPIC_NODES_INDEX_SIZE			PS_POW2_CEIL(2 * PS_MAX_TOPIC_NODES_COUNT) //size of the hash index of topics tree nodes, must be power of 2 and greater than PS_MAX_TOPIC_NODES_COUNT (x2 is recommended).
+#endif
+//size of the pool of path segments chars (segments have no length limit except the path one), default fits any paths of all topics.
+#ifndef PS_TOPIC_SEGMENTS_POOL_SIZE
+#define PS_TOPIC_SEGMENTS_POOL_SIZE			(PS_MAX_TOPICS_COUNT * PS_MAX_TOPIC_PATH_STR_LENGTH)
+#endif
+//max count of different actors (publishers and subscribers) in the system, up to 32. Ids are not reused: every typed subscriber
+//(ps::Topic<T>::subscribe<Fn>() trampoline) and the NULL publisher of the topics change topic take one.
+#ifndef PS_MAX_ACTORS_COUNT
+#define PS_MAX_ACTORS_COUNT					(16)
+#endif
+#ifndef PS_ACTORS_INDEX_SIZE
+#define PS_ACTORS_INDEX_SIZE				PS_POW2_CEIL(2 * PS_MAX_ACTORS_COUNT) //size of the hash index of actors, must be power of 2 and greater than PS_MAX_ACTORS_COUNT.
+#endif
+#define PS_MAX_WILDCARD_SUBS_COUNT			(4) //max count of wildcard subscriptions (like ".hw.tty.*" or ".hw.#"), at least 1.
 #define PS_MAX_TOPIC_PATH_STR_LENGTH		(64)
 #define PS_MAX_TOPIC_INFO_STR_LENGTH		(64)
 #define PS_MAX_SUBSCRIBER_INFO_STR_LENGTH	(64)
-#define PS_MAX_MESSAGE_PAYLOAD_LENGTH		(64)
-#define PS_MSG_HDR_LENGTH					(sizeof(PsTopicHash_t) + sizeof(psMsgLen_t)) //to get msg size in the queue add payload size to the header size.
+#define PS_MAX_MESSAGE_PAYLOAD_LENGTH		(64) //max payload carried inline in the message queue, also capacity of topics registered without explicit size.
+#ifndef PS_PAYLOAD_POOL_SIZE
+#define PS_PAYLOAD_POOL_SIZE				(256) //variable-block pool for payloads longer than PS_MAX_MESSAGE_PAYLOAD_LENGTH and for last values of "sticky" topics, up to 512K.
+#endif
+#define PS_MSG_QUEUE_BUF_SIZE				(1024) //size of the message queue (of each producer queue in multi-producer build), see also PS_PRIORITY_QUEUE_BUF_SIZE.
+//multi-producer build: number of lock-free message queues (up to 32), every thread that publishes claims its own queue on first publishing
+//and owns it till ps_release_producer_queue() or its exit.
+//ps_pub_topic()/ps_pub_topic_reserve()/ps_pub_topic_commit() then can be called from different threads without locks. 0 - disabled (single queue).
+//Requires CQ_CFG_LOCK_FREE_SPSC.
+#ifndef PS_PRODUCER_QUEUES_COUNT
+#define PS_PRODUCER_QUEUES_COUNT			(0)
+#endif
+//size of the lock-free queue for messages posted by ps_pub_topic_from_isr(), 0 - disabled. Requires CQ_CFG_LOCK_FREE_SPSC.
+#ifndef PS_ISR_MSG_QUEUE_BUF_SIZE
+#define PS_ISR_MSG_QUEUE_BUF_SIZE			(0)
+#endif
+//priority classes of topics (see ps_set_topic_priority()), up to 4. Every class has its own message queue (per producer in multi-producer build),
+//ps_loop() dispatches messages of the highest non-empty class first. Class 0 is the lowest one and the class of all topics by default.
+#ifndef PS_PRIORITY_LEVELS_COUNT
+#define PS_PRIORITY_LEVELS_COUNT			(1)
+#endif
+//queue buffer size of the priority class, e.g. ((level) ? 256 : 1024) for small queue of urgent events.
+#ifndef PS_PRIORITY_QUEUE_BUF_SIZE
+#define PS_PRIORITY_QUEUE_BUF_SIZE(level)	(PS_MSG_QUEUE_BUF_SIZE)
+#endif
+//anti-starvation quota: max count of messages of the class dispatched in a row while lower classes are waiting, 0 - strict priority.
+#ifndef PS_PRIORITY_QUOTA
+#define PS_PRIORITY_QUOTA(level)			(16)
+#endif
+#define PS_MAX_INLINE_DEPTH					(4) //max nesting of inline deliveries (see ps_set_topic_inline()), deeper messages go through the queue.
+//loaned buffers: count of fixed blocks published by ps_pub_loaned_buffer() without copies (queue carries only a handle), 0 - disabled.
+#ifndef PS_LOAN_BLOCKS_COUNT
+#define PS_LOAN_BLOCKS_COUNT				(0)
+#endif
+//timer topics (see ps_create_and_sub_timer_topic()) are kept in a hierarchical timer wheel: levels of 32 slots, slot of the level N is 32^N ms long.
+#ifndef PS_MAX_TIMERS_COUNT
+#define PS_MAX_TIMERS_COUNT					(8) //max count of timer topics
+#endif
+#ifndef PS_TIMER_WHEEL_LEVELS
+#define PS_TIMER_WHEEL_LEVELS				(5) //1..6, longer timeouts than 32^levels ms (9.3 hours for 5 levels) are rescheduled by the top level on the way
+#endif
+#ifndef PS_LOAN_BLOCK_SIZE
+#define PS_LOAN_BLOCK_SIZE					(4096) //size of the loaned block in bytes, up to 65535.
+#endif
+#define PS_MSG_HDR_LENGTH					(sizeof(PsTopicHash_t)) //to get msg size in the queue add payload size to the header size.
 //names of the pub/sub dispatcher serviced topics
 #define PS_SYS_SERVICED_PERIODIC_MS_TIMER_TOPIC ".srv.t_ms.tick" //periodic timers
 #define PS_SYS_SERVICED_SINGLE_MS_TIMER_TOPIC   ".srv.t_ms.tout"   //single shot timers
+#define PS_IDLE_FOREVER		(-1) //idle time when there are no events and no timers, see ps_get_idle_time_ms()
 #define PS_SYS_SERVICED_TOPICS_CHANGE_TOPIC     ".srv.tpc.chng"   //changes in the topics list (adding and removing topics will be indicated here).
 
 //typeof data encapsulated in the IPC message
@@ -73,23 +151,75 @@ typedef enum {
 	PS_RESULT_CREATED,	
 } PsResultType_e;
 
+//what publishing does when the message doesn't fit into the queue, see ps_set_topic_overflow_policy().
+typedef enum {
+	PS_OVERFLOW_FAIL = 0, //message is not posted, publishing returns PS_RESULT_OUT_OF_MEM (default)
+	PS_OVERFLOW_DROP_NEWEST, //message is not posted, publishing returns PS_RESULT_OK
+	PS_OVERFLOW_DROP_OLDEST, //the oldest waiting messages of the same topic are dropped to make space (single-producer build only)
+	PS_OVERFLOW_OVERWRITE_OLDEST, //the oldest waiting messages of any topic are dropped to make space (single-producer build only)
+	PS_OVERFLOW_BLOCK, //publisher waits till ps_loop() makes space or timeout expires (multi-producer build only), the thread of ps_loop() fails at once
+	PS_OVERFLOW_COUNT
+} PsOverflowPolicy_e;
+
 typedef uint16_t PsMsgLen_t;
 typedef uint16_t PsTopicHash_t;
-//pointer to function that will handle message (actor)
+//pointer to function that will handle message (actor). pvMsg may point directly into the message queue buffer, so it's read only and valid only during the call.
 typedef const char * (*actor_f)(PsTopicHash_t xTopicHash, void* pvMsg, size_t xMsgLendth, PsDataType_e xMsgDataType);
 typedef void(*restart_timer_f)(long int tout_ms);
+typedef void(*topic_visitor_f)(PsTopicHash_t xTopicHash, void * pvContext);
 typedef long int(*get_timer_tick_ms_f)();
+typedef uint32_t(*get_time_us_f)();
+typedef void(*queue_watermark_f)(uint8_t u8Priority, uint8_t u8HighFlag);
+typedef void(*enter_sleep_f)(long int max_ms);
+typedef void(*on_wakeup_f)();
+typedef void(*cancel_sleep_f)();
+
+//topic known at build time, see ps_register_static_topics() and pubsub_static.h.
+typedef struct _PsStaticTopicStruct_s {
+	const char * pu8TopicPathStr;
+	const char * pu8TopicInfoStr;
+	PsDataType_e xDtype;
+	uint8_t u8Sticky_flag;
+	PsMsgLen_t xMaxMsgLen; //payload capacity of the topic, 0 - PS_MAX_MESSAGE_PAYLOAD_LENGTH
+} PsStaticTopicStruct_s;
+
+//publisher or subscriber of the static topic, xTopicHash is index of the topic in the static topics table.
+typedef struct _PsStaticActorLinkStruct_s {
+	PsTopicHash_t xTopicHash;
+	actor_f pxActorHandler;
+	uint8_t u8PublisherFlag; //1 - publisher, 0 - subscriber
+} PsStaticActorLinkStruct_s;
 
 
 //*******************************   Basic API ***************************************************
 /** Attention!!!
     All APIs here are not thread safe, so to use it as part of different threads or inside an IRQ - you have to wrap it in critical sections.
+    The only exceptions are ps_pub_topic_from_isr() (see its description) and publishing functions in multi-producer build
+    (see PS_PRODUCER_QUEUES_COUNT). In multi-producer build messages of one thread are dispatched in order of publishing,
+    but there is no order between messages of different threads.
 */
 
 //returns -1 if failed, 0 - if ok.
 PsResultType_e ps_init(restart_timer_f pxRestart_timer, get_timer_tick_ms_f pxGet_timer_tick_ms);
 
 PsResultType_e ps_register_topic_publisher(actor_f pxActorHandler, PsDataType_e xDataType, const char * pu8TopicPathStr, const char * pu8TopicInfoStr, uint8_t u8Sticky_flag, PsTopicHash_t * pxTopicHash);
+/** @brief registers publisher of the topic with payload capacity different from PS_MAX_MESSAGE_PAYLOAD_LENGTH (ps_register_topic_publisher() uses it by default).
+*  @param  xMaxMsgLen - max payload length of the topic messages. Messages longer than PS_MAX_MESSAGE_PAYLOAD_LENGTH are kept in the payload pool
+*  (see PS_PAYLOAD_POOL_SIZE) and the queue carries only a reference, "sticky" value takes xMaxMsgLen bytes of the pool.
+*  @return  result of the operation as PsResultType_e type, PS_RESULT_REDEF_CONFLICT if the topic already has publishers and smaller capacity,
+*  PS_RESULT_OUT_OF_MEM if messages of xMaxMsgLen fit neither the payload pool nor a loaned block (PS_LOAN_BLOCK_SIZE).
+*  @note capacity is declared by the first publisher of the topic, other publishers can't extend it.
+*/
+PsResultType_e ps_register_topic_publisher_sized(actor_f pxActorHandler, PsDataType_e xDataType, const char * pu8TopicPathStr, const char * pu8TopicInfoStr, uint8_t u8Sticky_flag, PsMsgLen_t xMaxMsgLen, PsTopicHash_t * pxTopicHash);
+/** @brief registers topics, publishers and subscribers declared at build time in constant tables (see pubsub_static.h).
+*  @param  pxTopics - static topics table, i-th topic of the table gets topic hash i, so hashes are known at compile time.
+*  @param  xTopicsCount - count of topics in the table.
+*  @param  pxLinks - publishers and subscribers of the static topics, may be NULL.
+*  @param  xLinksCount - count of entries in pxLinks.
+*  @return  result of the operation as PsResultType_e type, PS_RESULT_OUT_OF_MEM if capacity of a topic can't be served (see ps_register_topic_publisher_sized()).
+*  @note must be called right after ps_init() before any other topic is created.
+*/
+PsResultType_e ps_register_static_topics(const PsStaticTopicStruct_s * pxTopics, PsTopicHash_t xTopicsCount, const PsStaticActorLinkStruct_s * pxLinks, size_t xLinksCount);
 PsResultType_e ps_unregister_topic_publisher(actor_f pxActorHandler, PsTopicHash_t xTopicHash);
 
 
@@ -110,29 +240,187 @@ PsResultType_e ps_pub_topic_with_registration(actor_f pxActorHandler, PsDataType
 *	exit_critical_section();
 */
 PsResultType_e ps_pub_topic(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsMsgLen_t xMsgLen, void * pvData);
+/** @brief posts value of the scalar topic (PS_DTYPE_U8..PS_DTYPE_I64, PS_DTYPE_BOOL) without passing it by pointer.
+*  @param  pxActorHandler - publisher of the message.
+*  @param  xTopicHash - hash of topic to which we are going to post.
+*  @param  u64Value - value to post, it's truncated to the size of the topic data type (signed values are cast to uint64_t).
+*  @return  result of the operation as PsResultType_e type, PS_RESULT_ERROR if data type of the topic isn't scalar.
+*/
+PsResultType_e ps_pub_scalar(actor_f pxActorHandler, PsTopicHash_t xTopicHash, uint64_t u64Value);
+/** @brief reserves space for a message in the queue, so publisher can serialize payload directly into the queue buffer without intermediate copies.
+*  @param  pxActorHandler - publisher of the message.
+*  @param  xTopicHash - hash of topic to which we are going to post.
+*  @param  xMaxMsgLen - max length of the message payload.
+*  @param  pxRegion - filled with one or two (if queue buffer wraps) writable spans for the payload, use cq_copyToRegion() or write spans directly.
+*  Payload longer than PS_MAX_MESSAGE_PAYLOAD_LENGTH is reserved in the payload pool as a single span.
+*  @return  result of the operation as PsResultType_e type, PS_RESULT_OUT_OF_MEM if xMaxMsgLen exceeds capacity of the topic.
+*  @note reserved message must be finished by ps_pub_topic_commit() before any other message is published.
+*/
+PsResultType_e ps_pub_topic_reserve(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsMsgLen_t xMaxMsgLen, CQ_REGION_S * pxRegion);
+/** @brief posts a message reserved by ps_pub_topic_reserve() into the queue.
+*  @param  xMsgLen - actual length of the message payload, must not exceed reserved length.
+*  @return  result of the operation as PsResultType_e type.
+*/
+PsResultType_e ps_pub_topic_commit(PsMsgLen_t xMsgLen);
+#if PS_LOAN_BLOCKS_COUNT
+/** @brief takes a free block of the loaned buffers pool (available if PS_LOAN_BLOCKS_COUNT > 0), so a large payload can be produced in place.
+*  @return  pointer to the block of PS_LOAN_BLOCK_SIZE bytes aligned for any data type, NULL if all blocks are in use.
+*  @note the caller owns the block till it's published or returned by ps_release_buffer().
+*/
+void * ps_loan_buffer();
+/** @brief posts the loaned buffer without copying it: the queue carries only a handle and subscribers get pointer to the block itself.
+*  @param  pxActorHandler - publisher of the message.
+*  @param  xTopicHash - hash of topic to which we are going to post.
+*  @param  xMsgLen - length of the payload, limited by PS_LOAN_BLOCK_SIZE and by capacity of the topic.
+*  @param  pvBuffer - block returned by ps_loan_buffer().
+*  @return  result of the operation as PsResultType_e type.
+*  @note on success ownership of the publisher passes to the message, block returns to the pool when the last subscriber returns
+*  (unless subscriber keeps it by ps_retain_buffer()). Publisher must not change the block after publishing, to post it once more
+*  (e.g. into another topic) call ps_retain_buffer() before. On failure the publisher still owns the block.
+*/
+PsResultType_e ps_pub_loaned_buffer(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsMsgLen_t xMsgLen, void * pvBuffer);
+//adds owner of the loaned block, subscriber may call it for pvMsg of the loaned buffer to use it after return. Returns PS_RESULT_ERROR for other pointers.
+PsResultType_e ps_retain_buffer(const void * pvBuffer);
+//drops ownership taken by ps_loan_buffer() or ps_retain_buffer(), the block returns to the pool when it has no owners.
+PsResultType_e ps_release_buffer(const void * pvBuffer);
+#endif
+/** @brief posts a message into a dedicated lock-free queue without critical sections (available if PS_ISR_MSG_QUEUE_BUF_SIZE > 0).
+*  @param  pxActorHandler - publisher of the message.
+*  @param  xTopicHash - hash of topic to which we are going to post.
+*  @param  xMsgLen - length of the message to post.
+*  @param  pvData - pointer to the data of the message to post.
+*  @return  result of the operation as PsResultType_e type.
+*  @note can be called concurrently with ps_loop() from exactly one context (single ISR or single producer thread).
+*  Topic and its publisher must be registered before the producer starts. "Sticky" value is updated when ps_loop() dispatches the message.
+*  Payload pool isn't used from ISR, so messages are limited to PS_MAX_MESSAGE_PAYLOAD_LENGTH. NULL pvData posts zeroed payload of xMsgLen bytes.
+*/
+PsResultType_e ps_pub_topic_from_isr(actor_f pxActorHandler, PsTopicHash_t xTopicHash, PsMsgLen_t xMsgLen, void * pvData);
+//Topic path of ps_sub_single_topic()/ps_unsub_topic() may be a pattern: "*" segment matches exactly one segment, "#" (allowed as the last segment only)
+//matches the rest of the path including nothing, so ".hw.#" matches ".hw" and ".hw.tty.cfg". Pattern is resolved into subscribers lists of matching
+//topics at subscription and at topic creation, so dispatching stays free of pattern matching. Sticky data and topic hash are not reported for patterns.
 PsResultType_e ps_sub_single_topic(const char * pu8TopicPathStr, PsDataType_e xDataType, actor_f pxActorHandler, PsTopicHash_t * pxTopicHash, void** pvMsg, size_t * pxMsgLendth, PsDataType_e * pxMsgDataType);
 PsResultType_e ps_unsub_topic(const char * pu8TopicPathStr, actor_f pxActorHandler);
 PsResultType_e ps_create_and_sub_timer_topic(const char * pu8TopicPathStr, actor_f pxActorHandler, const char * pu8TopicInfoStr, long int tout_ms);
 
 PsResultType_e ps_check_topic(const char * pu8TopicPathStr, PsDataType_e * pxDataType, char * pu8TopicInfoStr, PsTopicHash_t * pxTopicHash);
-PsResultType_e ps_check_topic_by_hash(PsTopicHash_t xTopicHash, const char ** pu8TopicPathStr, const char ** pu8TopicInfoStr, PsDataType_e * pxDataType);
+//path is built from the topics tree into pu8TopicPathStr - caller's buffer of PS_MAX_TOPIC_PATH_STR_LENGTH chars (NULL if the path isn't needed).
+PsResultType_e ps_check_topic_by_hash(PsTopicHash_t xTopicHash, char * pu8TopicPathStr, const char ** pu8TopicInfoStr, PsDataType_e * pxDataType);
 
 const char * ps_check_subscriber(actor_f pxSubscriber);
 
+/** @brief processes timer topics, to be called when timeout of restart_timer_f expires.
+*  Time passed since the last restart_timer_f call is read by get_timer_tick_ms_f, events of expired timers are published
+*  and the timer is restarted for the next deadline of the timer wheel (INT32_MAX if there are no timers).
+*  @note deadline of a timer longer than 32^(PS_TIMER_WHEEL_LEVELS - 1) ms may come earlier than the timer expires,
+*  the call then only moves the timer to a lower level of the wheel.
+*/
 void ps_pub_timer_tout_event();
 
 //returns -1 if failed, otherwise - count of events waiting to be processed.
 int16_t ps_get_waiting_events_count();
 
-uint8_t ps_has_enough_msg_space(size_t bytes_to_publish);
+//returns 1 if the queue of the topic (of its priority class) has room for bytes_to_publish bytes.
+uint8_t ps_has_enough_msg_space(PsTopicHash_t xTopicHash, size_t bytes_to_publish);
+/** @brief returns producer queue of the calling thread to the free ones (multi-producer build, no-op otherwise).
+*  Called automatically when the thread exits, thread pools call it when the task that published is done.
+*  @note the thread must not have a pending ps_pub_topic_reserve(), it claims a queue again on the next publishing.
+*  Messages already posted stay in the queue and are dispatched before messages of its next owner.
+*/
+void ps_release_producer_queue();
 
 //returns -1 if failed, otherwise - count of processed events.
 int16_t ps_loop();
 
+/** @brief processes up to u16MaxMsgs events per call. Queue space of each processed event is released as soon as its subscribers return.
+*  @param  u16MaxMsgs - max count of events to process.
+*  @param  pi16Remaining - if not NULL, receives count of events still waiting to be processed.
+*  @return  -1 if failed, otherwise - count of processed events.
+*/
+int16_t ps_loop_n(uint16_t u16MaxMsgs, int16_t * pi16Remaining);
+/** @brief processes events until queue is empty or time budget is spent (at least one event is processed if available).
+*  @param  u32BudgetUs - time budget in microseconds, time source must be set by ps_set_time_us_source().
+*  @param  pi16Remaining - if not NULL, receives count of events still waiting to be processed.
+*  @return  -1 if failed, otherwise - count of processed events.
+*/
+int16_t ps_loop_for(uint32_t u32BudgetUs, int16_t * pi16Remaining);
+//sets free running microsecond time source used by ps_loop_for().
+void ps_set_time_us_source(get_time_us_f pxGet_time_us);
+
+/** @brief sets low power mode hooks used by ps_idle().
+*  @param  pxEnterSleep - sleeps for max_ms at most (PS_IDLE_FOREVER - till an interrupt) and returns on any interrupt. On MCU it's usually
+*  "disable interrupts; if (!ps_is_sleep_cancelled()) WFI; enable interrupts", so message posted from ISR right before WFI doesn't get stuck.
+*  @param  pxOnWakeup - called after pxEnterSleep returns (clocks restoring etc.), may be NULL.
+*  @param  pxCancelSleep - called by the publisher that posts a message while ps_idle() sleeps (ISR or producer thread), may be NULL.
+*  Hosted builds set the event pxEnterSleep waits for, on MCU the interrupt itself ends WFI.
+*  @return  result of the operation as PsResultType_e type.
+*/
+PsResultType_e ps_set_idle_hooks(enter_sleep_f pxEnterSleep, on_wakeup_f pxOnWakeup, cancel_sleep_f pxCancelSleep);
+//returns 0 if events are waiting to be processed, otherwise - ms till the next timer deadline or PS_IDLE_FOREVER if there are no timers.
+long int ps_get_idle_time_ms();
+/** @brief sleeps by the hook of ps_set_idle_hooks() till the next timer deadline if there are no events to process,
+*  after waking up processes expired timers (so the timer interrupt only has to wake the system), e.g. "while (1) { ps_loop(); ps_idle(); }".
+*  @return  1 if the system slept, 0 if there were events to process (or ps_set_idle_hooks() wasn't called).
+*/
+uint8_t ps_idle();
+//returns 1 if a message was posted after ps_idle() decided to sleep, so the sleep must not start, to be called by enter_sleep_f.
+uint8_t ps_is_sleep_cancelled();
+
 //*******************************   Extended optional API ***************************************************
 
 //mute exact event source (identified by publisher + topic). It leaves possibility to publish into the topic for other sources. 
 //This functionality is intended to be used for testing/debugging by sustituting some event sources with test events triggered via console.
 PsResultType_e ps_pub_mute(actor_f pxActorHandler, const char * pu8TopicPathStr, uint8_t u8MuteFlag);
 PsResultType_e ps_pub_mute_by_hash(actor_f pxActorHandler, PsTopicHash_t xTopicHash, uint8_t u8MuteFlag);
-PsResultType_e ps_create_and_sub_tpc_change_topic(actor_f pxActorHandler);
\ No newline at end of file
+/** @brief makes publishing into the topic call its subscribers synchronously instead of posting the message into the queue (for latency critical topics).
+*  @param  xTopicHash - hash of the topic.
+*  @param  u8InlineFlag - 1 - deliver inline, 0 - through the queue (default).
+*  @return  result of the operation as PsResultType_e type.
+*  @note subscribers run in the context (thread) of the publisher before ps_pub_topic() returns, so inline message can overtake messages
+*  of the topic still waiting in the queue. If subscribers publish into inline topics deeper than PS_MAX_INLINE_DEPTH, the message goes
+*  through the queue. ps_pub_topic_from_isr() always uses the queue.
+*  In multi-producer build subscribers of the inline topic (and update of its "sticky" value) run on the publishing thread
+*  concurrently with ps_loop() and other producers, so they must be thread-safe.
+*/
+PsResultType_e ps_set_topic_inline(PsTopicHash_t xTopicHash, uint8_t u8InlineFlag);
+/** @brief makes the topic "latest value only" (for state topics like ".hw.tty.cfg.speed"): at most one message of the topic waits in the queue,
+*  newer value overwrites its payload and the message keeps its place in the dispatch order.
+*  @param  xTopicHash - hash of the topic.
+*  @param  u8ConflateFlag - 1 - conflate values, 0 - queue every value (default).
+*  @return  result of the operation as PsResultType_e type.
+*  @note waiting value takes a block of the topic capacity in the payload pool (see PS_PAYLOAD_POOL_SIZE), newer values are copied into it
+*  without allocation, so queue and pool usage of conflating topics is bounded by their count. Value longer than PS_MAX_MESSAGE_PAYLOAD_LENGTH
+*  written by ps_pub_topic_reserve() is staged in one more block of its length till ps_pub_topic_commit(). Messages of ps_pub_loaned_buffer() and ps_pub_topic_from_isr() are not conflated.
+*/
+PsResultType_e ps_set_topic_conflated(PsTopicHash_t xTopicHash, uint8_t u8ConflateFlag);
+/** @brief sets priority class of the topic (see PS_PRIORITY_LEVELS_COUNT), its messages are posted into the queue of the class.
+*  @param  xTopicHash - hash of the topic.
+*  @param  u8Priority - priority class, 0 (default) - the lowest one.
+*  @return  result of the operation as PsResultType_e type, PS_RESULT_ERROR if the class doesn't exist.
+*  @note messages of different classes are dispatched out of publishing order, set the class before publishing into the topic.
+*  Messages of ps_pub_topic_from_isr() are dispatched with the highest class regardless of the topic class.
+*/
+PsResultType_e ps_set_topic_priority(PsTopicHash_t xTopicHash, uint8_t u8Priority);
+/** @brief sets what publishing into the topic does when its message doesn't fit into the queue.
+*  @param  xTopicHash - hash of the topic.
+*  @param  xPolicy - overflow policy, PS_OVERFLOW_FAIL by default.
+*  @param  u16TimeoutMs - max time to wait for PS_OVERFLOW_BLOCK (measured by the monotonic clock of the system), ignored by other policies.
+*  @return  result of the operation as PsResultType_e type, PS_RESULT_ERROR if the policy isn't available in this build.
+*  @note messages are dropped only while ps_loop() isn't dispatching the queue (so not by subscribers publishing into a full queue),
+*  otherwise the new message fails as with PS_OVERFLOW_FAIL. PS_OVERFLOW_BLOCK doesn't wait in the thread calling ps_loop() (including its subscribers),
+*  nothing would make space there. ps_pub_topic_from_isr() always fails on overflow.
+*/
+PsResultType_e ps_set_topic_overflow_policy(PsTopicHash_t xTopicHash, PsOverflowPolicy_e xPolicy, uint16_t u16TimeoutMs);
+/** @brief sets backpressure callback, so producers (like DMA readers) can throttle themselves before messages are lost.
+*  @param  u8HighPercent - fill level of a message queue (% of its buffer), reaching it calls pxCallback(priority, 1) in the publisher context.
+*  @param  u8LowPercent - fill level below which queue drains after the high watermark, ps_loop() calls pxCallback(priority, 0) then.
+*  @param  pxCallback - callback, u8Priority is class of the queue (PS_PRIORITY_LEVELS_COUNT for the ISR queue). NULL disables watermarks.
+*  @return  result of the operation as PsResultType_e type, PS_RESULT_ERROR if u8LowPercent isn't below u8HighPercent.
+*  @note in multi-producer build every producer queue has its own watermarks state.
+*/
+PsResultType_e ps_set_queue_watermarks(uint8_t u8HighPercent, uint8_t u8LowPercent, queue_watermark_f pxCallback);
+PsResultType_e ps_create_and_sub_tpc_change_topic(actor_f pxActorHandler);
+//calls pxVisitor for the topic with given path and for all topics in its subtree (".hw.tty" visits ".hw.tty.cfg.speed"), NULL path visits all topics.
+//Topics must not be added by the visitor, it may remove only the visited topic. Returns PS_RESULT_NOT_FOUND if the path is not present in the topics tree.
+PsResultType_e ps_for_each_topic(const char * pu8TopicPathStr, topic_visitor_f pxVisitor, void * pvContext);
+
+#endif /* PS_H */
@@ -0,0 +1,133 @@
+/*
+============================================================================
+Name        : pubsub_static.h
+Author      : Valerii Proskurin
+Version     : v 0.0.1 alpha
+Copyright   : Copyright (c) 2023, Valerii Proskurin. All rights reserved.
+Description : compile time declaration of topics known at build time (C++11).
+Topics are declared in a constant table, their hashes (indexes in the table) are
+resolved from paths by the compiler and data types of publishing are checked at
+compile time. The table is registered by ps_register_static_topics().
+Example:
+	constexpr PsStaticTopicStruct_s AppTopics[] = {
+		PS_STATIC_TOPIC(uint32_t, ".hw.tty.cfg.speed", "uart speed", 1),
+		PS_STATIC_TOPIC(bool, ".hw.led", "led state", 0),
+		PS_STATIC_TOPIC_SIZED(uint8_t, ".hw.tty.data", "uart frames", 0, 128),
+	};
+	PS_STATIC_TOPICS_CHECK(AppTopics);
+	PS_STATIC_TOPIC_HANDLE(TtySpeed, AppTopics, uint32_t, ".hw.tty.cfg.speed");
+	const PsStaticActorLinkStruct_s AppLinks[] = {
+		PS_STATIC_PUBLISHER(TtySpeed, tty_act),
+		PS_STATIC_SUBSCRIBER(TtySpeed, cfg_act),
+	};
+	...
+	ps_init(restart_timer, get_timer_tick_ms);
+	ps_register_static_topics(AppTopics, ps::topics_count(AppTopics), AppLinks, sizeof(AppLinks) / sizeof(AppLinks[0]));
+	ps::pub<TtySpeed>(tty_act, 115200u);
+License     : SPDX-License-Identifier: GPL-3.0-or-later OR commercial.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+In addition, this program is available under a commercial license
+from author (Valerii Proskurin). If you do not wish to be bound by the
+terms of the GPL, or you require a more permissive license for commercial use,
+please contact author via easyvolts@gmail.com for licensing options.
+============================================================================
+*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef PS_STATIC_H
+#define PS_STATIC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include "pubsub.h"
+#include "pubsub_typed.h" //ps::dtype_of
+
+namespace ps {
+
+//not constexpr on purpose: reaching it while evaluating a constant expression fails the build.
+inline PsTopicHash_t static_topic_is_not_declared() { return 0; }
+
+constexpr bool path_equal(const char * pu8PathA, const char * pu8PathB) {
+	return (*pu8PathA == *pu8PathB) && (('\0' == *pu8PathA) || path_equal(pu8PathA + 1, pu8PathB + 1));
+}
+
+template <size_t N>
+constexpr PsTopicHash_t topics_count(const PsStaticTopicStruct_s (&)[N]) {
+	return (PsTopicHash_t)N;
+}
+
+//hash of the static topic (its index in the table) resolved from the path at compile time.
+template <size_t N>
+constexpr PsTopicHash_t topic_hash(const PsStaticTopicStruct_s (&pxTopics)[N], const char * pu8TopicPathStr, size_t i = 0) {
+	return (i >= N) ? static_topic_is_not_declared() :
+		path_equal(pxTopics[i].pu8TopicPathStr, pu8TopicPathStr) ? (PsTopicHash_t)i : topic_hash(pxTopics, pu8TopicPathStr, i + 1);
+}
+
+template <size_t N>
+constexpr bool path_declared_after(const PsStaticTopicStruct_s (&pxTopics)[N], size_t i, size_t j) {
+	return (j < N) && (path_equal(pxTopics[i].pu8TopicPathStr, pxTopics[j].pu8TopicPathStr) || path_declared_after(pxTopics, i, j + 1));
+}
+
+//longest capacity a topic can have: its messages are kept inline, in the payload pool or in a loaned block.
+constexpr size_t max_topic_capacity() {
+	return ((PS_LOAN_BLOCKS_COUNT != 0) && (PS_LOAN_BLOCK_SIZE > ((PS_PAYLOAD_POOL_SIZE + 7) / 8 - 1) * 8)) ? PS_LOAN_BLOCK_SIZE :
+		(PS_MAX_MESSAGE_PAYLOAD_LENGTH > ((PS_PAYLOAD_POOL_SIZE + 7) / 8 - 1) * 8) ? PS_MAX_MESSAGE_PAYLOAD_LENGTH : ((PS_PAYLOAD_POOL_SIZE + 7) / 8 - 1) * 8;
+}
+
+template <size_t N>
+constexpr bool topics_capacity_served(const PsStaticTopicStruct_s (&pxTopics)[N], size_t i = 0) {
+	return (i >= N) || ((pxTopics[i].xMaxMsgLen <= max_topic_capacity()) && topics_capacity_served(pxTopics, i + 1));
+}
+
+//every path is declared once, so the same topic can't get two different data types.
+template <size_t N>
+constexpr bool topics_unique(const PsStaticTopicStruct_s (&pxTopics)[N], size_t i = 0) {
+	return (i >= N) || (!path_declared_after(pxTopics, i, i + 1) && topics_unique(pxTopics, i + 1));
+}
+
+//compile time handle of the static topic, produced by PS_STATIC_TOPIC_HANDLE().
+template <typename T, PsTopicHash_t xTopicHash>
+struct StaticTopic {
+	typedef T type;
+	static constexpr PsTopicHash_t hash = xTopicHash;
+};
+
+//publishes value of the static topic, value of another type (even implicitly convertible one like 3.7 or -5 for uint32_t) doesn't compile.
+template <typename Topic, typename V>
+inline PsResultType_e pub(actor_f pxActorHandler, const V & xValue) {
+	static_assert(std::is_same<V, typename Topic::type>::value, "value type differs from the data type of the static topic");
+	return ps_pub_topic(pxActorHandler, Topic::hash, sizeof(xValue), (void *)&xValue);
+}
+
+} // namespace ps
+
+#define PS_STATIC_TOPIC(type, path, info, sticky)	{ path, info, ps::dtype_of<type>::value, sticky, 0 }
+//topic with own payload capacity (like 128 byte frames of ".hw.tty.data"), messages longer than PS_MAX_MESSAGE_PAYLOAD_LENGTH go through the payload pool.
+//Each of them takes a pool block of its length rounded up to 8 bytes plus 8 bytes of header while it waits in the queue, "sticky" topic keeps
+//one more block of max_len, so PS_PAYLOAD_POOL_SIZE is sized for the long messages queued at once (longer capacities need loaned buffers).
+#define PS_STATIC_TOPIC_SIZED(type, path, info, sticky, max_len)	{ path, info, ps::dtype_of<type>::value, sticky, max_len }
+#define PS_STATIC_TOPICS_CHECK(table) \
+	static_assert(ps::topics_unique(table), "topic path is declared more than once in " #table); \
+	static_assert(ps::topics_count(table) <= PS_MAX_TOPICS_COUNT, "too many static topics in " #table); \
+	static_assert(ps::topics_capacity_served(table), "capacity of a topic in " #table " exceeds PS_PAYLOAD_POOL_SIZE and PS_LOAN_BLOCK_SIZE")
+//declares handle of the static topic, build fails if the path isn't in the table or it's declared with another data type.
+#define PS_STATIC_TOPIC_HANDLE(name, table, type, path) \
+	static_assert(ps::dtype_of<type>::value == table[ps::topic_hash(table, path)].xDtype, "data type of " path " differs from its declaration"); \
+	typedef ps::StaticTopic<type, ps::topic_hash(table, path)> name
+#define PS_STATIC_PUBLISHER(name, actor)	{ name::hash, actor, 1 }
+#define PS_STATIC_SUBSCRIBER(name, actor)	{ name::hash, actor, 0 }
+
+#endif /* PS_STATIC_H */
@@ -0,0 +1,148 @@
+/*
+============================================================================
+Name        : pubsub_typed.h
+Author      : Valerii Proskurin
+Version     : v 0.0.1 alpha
+Copyright   : Copyright (c) 2023, Valerii Proskurin. All rights reserved.
+Description : typed C++ layer over the pub/sub C API (C++11, header only).
+C++ payload types are mapped to PsDataType_e at compile time and subscribers are
+plain functions taking the typed value: a trampoline generated for each of them
+is the actor, so handlers don't check data type and don't cast void pointers.
+Example:
+	static ps::Topic<uint32_t> TtySpeed(".hw.tty.cfg.speed");
+	void on_speed(const uint32_t & u32Speed) { ... }
+	...
+	TtySpeed.advertise(tty_act, "uart speed");
+	TtySpeed.subscribe<on_speed>();
+	TtySpeed.publish(115200u);
+License     : SPDX-License-Identifier: GPL-3.0-or-later OR commercial.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+In addition, this program is available under a commercial license
+from author (Valerii Proskurin). If you do not wish to be bound by the
+terms of the GPL, or you require a more permissive license for commercial use,
+please contact author via easyvolts@gmail.com for licensing options.
+============================================================================
+*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef PS_TYPED_H
+#define PS_TYPED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "pubsub.h"
+
+namespace ps {
+
+//compile time mapping of payload C++ types to PsDataType_e, other types are declared by PS_DECLARE_DTYPE().
+template <typename T> struct dtype_of;
+template <> struct dtype_of<uint8_t> { static constexpr PsDataType_e value = PS_DTYPE_U8; };
+template <> struct dtype_of<int8_t> { static constexpr PsDataType_e value = PS_DTYPE_I8; };
+template <> struct dtype_of<uint16_t> { static constexpr PsDataType_e value = PS_DTYPE_U16; };
+template <> struct dtype_of<int16_t> { static constexpr PsDataType_e value = PS_DTYPE_I16; };
+template <> struct dtype_of<uint32_t> { static constexpr PsDataType_e value = PS_DTYPE_U32; };
+template <> struct dtype_of<int32_t> { static constexpr PsDataType_e value = PS_DTYPE_I32; };
+template <> struct dtype_of<uint64_t> { static constexpr PsDataType_e value = PS_DTYPE_U64; };
+template <> struct dtype_of<int64_t> { static constexpr PsDataType_e value = PS_DTYPE_I64; };
+template <> struct dtype_of<bool> { static constexpr PsDataType_e value = PS_DTYPE_BOOL; };
+template <> struct dtype_of<char> { static constexpr PsDataType_e value = PS_DTYPE_STR; };
+
+//topic carrying values of type T (fixed size, trivially copyable).
+template <typename T>
+class Topic {
+public:
+	typedef T type;
+	typedef void (*handler_f)(const T & xValue);
+	typedef void (*topic_handler_f)(PsTopicHash_t xTopicHash, const T & xValue);
+
+	explicit Topic(const char * pu8TopicPathStr) : pu8TopicPathStr(pu8TopicPathStr), xTopicHash(0), pxPublisher(NULL) {}
+
+	//registers the publisher of the topic, capacity of the topic is sizeof(T).
+	PsResultType_e advertise(actor_f pxActorHandler, const char * pu8TopicInfoStr = "", uint8_t u8Sticky_flag = 0) {
+		pxPublisher = pxActorHandler;
+		return ps_register_topic_publisher_sized(pxActorHandler, dtype_of<T>::value, pu8TopicPathStr, pu8TopicInfoStr, u8Sticky_flag, sizeof(T), &xTopicHash);
+	}
+
+	PsResultType_e publish(const T & xValue) const {
+		return ps_pub_topic(pxPublisher, xTopicHash, sizeof(T), (void *)&xValue);
+	}
+
+	//subscribes Fn, it's called with the value from ps_loop(). Fails with PS_RESULT_REDEF_CONFLICT if the topic has another data type.
+	template <handler_f Fn>
+	PsResultType_e subscribe() {
+		return subscribe_actor(&trampoline<handler_f, Fn>);
+	}
+	//same, Fn also gets hash of the topic (to tell topics apart if it's subscribed to several of them).
+	template <topic_handler_f Fn>
+	PsResultType_e subscribe() {
+		return subscribe_actor(&trampoline<topic_handler_f, Fn>);
+	}
+
+	template <handler_f Fn>
+	PsResultType_e unsubscribe() const {
+		return ps_unsub_topic(pu8TopicPathStr, &trampoline<handler_f, Fn>);
+	}
+	template <topic_handler_f Fn>
+	PsResultType_e unsubscribe() const {
+		return ps_unsub_topic(pu8TopicPathStr, &trampoline<topic_handler_f, Fn>);
+	}
+
+	PsTopicHash_t hash() const { return xTopicHash; }
+	const char * path() const { return pu8TopicPathStr; }
+
+private:
+	static void call(handler_f Fn, PsTopicHash_t xTopicHash, const T & xValue) { (void)xTopicHash; Fn(xValue); }
+	static void call(topic_handler_f Fn, PsTopicHash_t xTopicHash, const T & xValue) { Fn(xTopicHash, xValue); }
+
+	//actor generated for the handler: data type is checked once at subscription, so here is only the size check.
+	template <typename F, F Fn>
+	static const char * trampoline(PsTopicHash_t xTopicHash, void * pvMsg, size_t xMsgLendth, PsDataType_e xMsgDataType) {
+		(void)xMsgDataType;
+		if ((NULL == pvMsg) || (xMsgLendth < sizeof(T))) return "typed subscriber";
+		if (0 == ((uintptr_t)pvMsg % alignof(T))) {
+			call(Fn, xTopicHash, *static_cast<const T *>(pvMsg));
+		} else {
+			T xValue;
+			memcpy(&xValue, pvMsg, sizeof(T));
+			call(Fn, xTopicHash, xValue);
+		}
+		return NULL;
+	}
+
+	PsResultType_e subscribe_actor(actor_f pxActorHandler) {
+		PsDataType_e xDataType = PS_DTYPE_NONE;
+		PsResultType_e result = ps_sub_single_topic(pu8TopicPathStr, dtype_of<T>::value, pxActorHandler, &xTopicHash, NULL, NULL, NULL);
+		if (PS_RESULT_OK != result) return result;
+		(void)ps_check_topic_by_hash(xTopicHash, NULL, NULL, &xDataType);
+		if (dtype_of<T>::value != xDataType) {
+			(void)ps_unsub_topic(pu8TopicPathStr, pxActorHandler);
+			return PS_RESULT_REDEF_CONFLICT;
+		}
+		return PS_RESULT_OK;
+	}
+
+	const char * pu8TopicPathStr;
+	PsTopicHash_t xTopicHash;
+	actor_f pxPublisher;
+};
+
+} // namespace ps
+
+//maps user payload type (e.g. struct of a fixed layout) to the data type of its topics, must be used in the global namespace.
+#define PS_DECLARE_DTYPE(type, dtype) \
+	namespace ps { template <> struct dtype_of<type> { static constexpr PsDataType_e value = (dtype); }; }
+
+#endif /* PS_TYPED_H */